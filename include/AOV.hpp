@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include "Vector.hpp"
+
+// arbitrary output variables written next to the beauty pass
+enum AOVFlags : uint32_t
+{
+    AOV_ALBEDO = 1 << 0,      // reflectance at the first hit
+    AOV_NORMAL = 1 << 1,      // world space shading normal at the first hit
+    AOV_DEPTH = 1 << 2,       // distance from the camera to the first hit
+    AOV_MATERIAL_ID = 1 << 3, // Material::id of the first hit, -1 for background
+    AOV_DIRECT = 1 << 4,      // emission and light sampled at the first hit
+    AOV_INDIRECT = 1 << 5,    // everything that bounced at least once more
+    AOV_VARIANCE = 1 << 6,    // luminance variance of the pixel estimate
+};
+
+// first hit data of one camera path, filled by Scene::castRay
+struct AOVSample
+{
+    bool hit = false;
+    Vector3f albedo, normal;
+    float depth = 0;
+    int materialId = -1;
+    Vector3f direct, indirect;
+};
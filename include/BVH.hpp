@@ -10,6 +10,7 @@
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
+#include "MemoryArena.hpp"
 
 struct BVHBuildNode;
 // BVHAccel Forward Declarations
@@ -24,14 +25,31 @@ public:
     enum class SplitMethod { NAIVE, SAH };
 
     // BVHAccel Public Methods
+    // the primitives belong to the caller, the nodes to the BVHAccel
     BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
     Bounds3 WorldBound() const;
-    ~BVHAccel();
+    // (re)builds the tree over the primitives, quietly unlike the constructor
+    void Build();
+
+    // Updates the bounds and areas of all nodes bottom-up after primitives
+    // moved, keeping the tree. If that leaves the SAH cost above
+    // maxCostIncrease times the cost after the last build, the tree is
+    // rebuilt instead; returns whether it was.
+    bool Refit(float maxCostIncrease = DefaultMaxCostIncrease);
+    // expected cost of a ray through the tree, by the surface area heuristic
+    // with unit traversal and intersection costs
+    float SAHCost() const;
+    static constexpr float DefaultMaxCostIncrease = 1.5f;
 
     Intersection Intersect(const Ray &ray) const;
-    Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
+    // closest hit without its surface attributes, see Object::intersect
+    bool Intersect(const Ray &ray, HitRecord &hit) const;
+    // Motion: whether to interpolate the node bounds to ray.time, fixed per
+    // BVH so that static scenes don't test for it at every node
+    template <bool Motion>
+    bool getIntersection(BVHBuildNode* node, const Ray& ray, HitRecord& hit) const;
     bool IntersectP(const Ray &ray) const;
-    BVHBuildNode* root;
+    BVHBuildNode* root = nullptr;
 
     // BVHAccel Private Methods
     BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
@@ -40,6 +58,14 @@ public:
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
     std::vector<Object*> primitives;
+    // all BVHBuildNodes, in build order
+    MemoryArena nodes;
+    float buildCost = 0; // SAHCost() right after the last build
+    // whether any primitive moves, the nodes then have boundsClose and
+    // traversal interpolates to the ray time
+    bool motion = false;
+    void setBoundsClose(BVHBuildNode* node);
+    void refitNode(BVHBuildNode* node);
 
     void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf);
     void Sample(Intersection &pos, float &pdf);
@@ -50,6 +76,9 @@ struct BVHBuildNode {
     BVHBuildNode *left;
     BVHBuildNode *right;
     Object* object;
+    // bounds at shutter close, only in BVHs with motion; kept out of the
+    // node so that static BVHs don't pay for them
+    Bounds3* boundsClose = nullptr;
     float area;
 
 public:
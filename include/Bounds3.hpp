@@ -11,17 +11,13 @@ class Bounds3
     Vector3f pMin, pMax; // two points to specify the bounding box
     Bounds3()
     {
-        double minNum = std::numeric_limits<double>::lowest();
-        double maxNum = std::numeric_limits<double>::max();
-        pMax = Vector3f(minNum, minNum, minNum);
-        pMin = Vector3f(maxNum, maxNum, maxNum);
-    }
-    Bounds3(const Vector3f p) : pMin(p), pMax(p) {}
-    Bounds3(const Vector3f p1, const Vector3f p2)
-    {
-        pMin = Vector3f(fmin(p1.x, p2.x), fmin(p1.y, p2.y), fmin(p1.z, p2.z));
-        pMax = Vector3f(fmax(p1.x, p2.x), fmax(p1.y, p2.y), fmax(p1.z, p2.z));
+        // empty, so that any union with it is the other operand
+        pMax = Vector3f(std::numeric_limits<float>::lowest());
+        pMin = Vector3f(std::numeric_limits<float>::max());
     }
+    Bounds3(const Vector3f& p) : pMin(p), pMax(p) {}
+    Bounds3(const Vector3f& p1, const Vector3f& p2)
+        : pMin(Vector3f::Min(p1, p2)), pMax(Vector3f::Max(p1, p2)) {}
 
     Vector3f Diagonal() const { return pMax - pMin; }
     int maxExtent() const
@@ -41,13 +37,10 @@ class Bounds3
         return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
     }
 
-    Vector3f Centroid() { return 0.5 * pMin + 0.5 * pMax; }
+    Vector3f Centroid() { return 0.5f * pMin + 0.5f * pMax; }
     Bounds3 Intersect(const Bounds3& b)
     {
-        return Bounds3(Vector3f(fmax(pMin.x, b.pMin.x), fmax(pMin.y, b.pMin.y),
-                                fmax(pMin.z, b.pMin.z)),
-                       Vector3f(fmin(pMax.x, b.pMax.x), fmin(pMax.y, b.pMax.y),
-                                fmin(pMax.z, b.pMax.z)));
+        return Bounds3(Vector3f::Max(pMin, b.pMin), Vector3f::Min(pMax, b.pMax));
     }
 
     Vector3f Offset(const Vector3f& p) const
@@ -80,26 +73,30 @@ class Bounds3
         return (i == 0) ? pMin : pMax;
     }
 
-    inline bool IntersectP(const Ray& ray, const Vector3f& invDir,
-                           const std::array<int, 3>& dirisNeg) const;
+    // whether ray enters the box within [ray.tMin, tMax]
+    inline bool IntersectP(const Ray& ray, float tMax) const;
 };
 
 
 
-inline bool Bounds3::IntersectP(const Ray& ray, const Vector3f& invDir,
-                                const std::array<int, 3>& dirIsNeg) const
+inline bool Bounds3::IntersectP(const Ray& ray, float tMax) const
 {
-    Vector3f origin = ray.origin;
-    Vector3f tmin = (pMin - origin) * invDir;
-    Vector3f tmax = (pMax - origin) * invDir;
-    
-    if (dirIsNeg[0]) std::swap(tmin.x, tmax.x);
-    if (dirIsNeg[1]) std::swap(tmin.y, tmax.y);
-    if (dirIsNeg[2]) std::swap(tmin.z, tmax.z);
+    // the distances to both slabs of all three axes at once, per axis the
+    // nearer one is where the ray enters
+    Vector3f t0 = (pMin - ray.origin) * ray.direction_inv;
+    Vector3f t1 = (pMax - ray.origin) * ray.direction_inv;
+    float tEnter = std::max(maxComponent(Vector3f::Min(t0, t1)), ray.tMin);
+    float tExit = std::min(minComponent(Vector3f::Max(t0, t1)), tMax);
+    return tEnter <= tExit;
+}
 
-    float tEnter = std::max(std::max(tmin.x, tmin.y), tmin.z);
-    float tExit = std::min(std::min(tmax.x, tmax.y), tmax.z);
-    return tEnter <= tExit && tExit >= 0;
+// the box of a linear motion from a to b, at t in [0, 1]
+inline Bounds3 lerp(const Bounds3& a, const Bounds3& b, float t)
+{
+    Bounds3 ret;
+    ret.pMin = lerp(a.pMin, b.pMin, t);
+    ret.pMax = lerp(a.pMax, b.pMax, t);
+    return ret;
 }
 
 inline Bounds3 Union(const Bounds3& b1, const Bounds3& b2)
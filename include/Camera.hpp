@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include "Ray.hpp"
+#include "Vector.hpp"
+#include "Vector8.hpp"
+#include "global.hpp"
+
+enum CameraType { PINHOLE, THIN_LENS, ORTHOGRAPHIC };
+
+// Continuous raster position of a sample plus the lens sample in [0, 1)^2,
+// the latter only matters for the thin lens camera.
+struct CameraSample
+{
+    float x, y;
+    float lensU = 0.5f, lensV = 0.5f;
+    float time = 0; // in the shutter interval, see Ray::time
+};
+
+class Camera
+{
+public:
+    CameraType type = PINHOLE;
+    Vector3f eye = Vector3f(0, 0, 0);
+    Vector3f lookAt = Vector3f(0, 0, -1);
+    Vector3f up = Vector3f(0, 1, 0);
+    float fov = 40;            // vertical, in degrees
+    float aperture = 0;        // lens radius of the thin lens camera
+    float focusDistance = 1;   // distance of the plane in focus along the view axis
+    float orthoHeight = 1;     // world space height of the orthographic view
+    int width = 1, height = 1;
+
+    // recompute the camera basis, call after changing any of the above
+    void update()
+    {
+        forward = normalize(lookAt - eye);
+        right = normalize(crossProduct(forward, up));
+        cameraUp = crossProduct(right, forward);
+
+        float aspect = width / (float)height;
+        float halfHeight = type == ORTHOGRAPHIC ? orthoHeight * 0.5f
+                                                : std::tan(fov * 0.5f * M_PI / 180.f);
+        float halfWidth = halfHeight * aspect;
+        // raster (0, 0) is the top left corner of the image
+        dxCamera = right * (2 * halfWidth / width);
+        dyCamera = -cameraUp * (2 * halfHeight / height);
+        corner = right * -halfWidth + cameraUp * halfHeight;
+        if (type != ORTHOGRAPHIC)
+            corner = corner + forward;
+    }
+
+    // the ray's footprint cone follows from the change of its origin or
+    // direction per pixel step
+    Ray generateRay(const CameraSample& s) const
+    {
+        Vector3f p = corner + dxCamera * s.x + dyCamera * s.y;
+        if (type == ORTHOGRAPHIC)
+        {
+            Ray ray(eye + p, forward);
+            ray.coneWidth = std::sqrt(dxCamera.norm() * dyCamera.norm());
+            ray.time = s.time;
+            return ray;
+        }
+
+        // derivative of normalize(p) along the raster axes
+        float invLen = 1 / std::sqrt(dotProduct(p, p));
+        Vector3f dir = p * invLen;
+        auto dNormalized = [&](const Vector3f& dp) {
+            return (dp - dir * dotProduct(dir, dp)) * invLen;
+        };
+        Vector3f dDdx = dNormalized(dxCamera), dDdy = dNormalized(dyCamera);
+
+        Vector3f origin = eye;
+        if (type == THIN_LENS && aperture > 0)
+        {
+            // all rays through the lens meet again on the focus plane
+            Vector3f focus = eye + dir * (focusDistance / dotProduct(dir, forward));
+            float lx, ly;
+            concentricDisk(s.lensU, s.lensV, lx, ly);
+            origin = eye + right * (lx * aperture) + cameraUp * (ly * aperture);
+            dir = normalize(focus - origin);
+        }
+
+        Ray ray(origin, dir);
+        ray.coneSpread = std::sqrt(dDdx.norm() * dDdy.norm());
+        ray.time = s.time;
+        return ray;
+    }
+
+    // one ray per sample, the same as generateRay gives; the renderer passes
+    // all samples of a pixel at once
+    void generateRays(const std::vector<CameraSample>& samples, std::vector<Ray>& rays) const
+    {
+        rays.clear();
+        rays.reserve(samples.size());
+        size_t i = 0;
+        if (type == PINHOLE)
+            for (; i + 8 <= samples.size(); i += 8)
+                generatePinholeRays8(&samples[i], rays);
+        for (; i < samples.size(); ++i)
+            rays.push_back(generateRay(samples[i]));
+    }
+
+private:
+    // generateRay of a pinhole camera for 8 samples at once, appends the rays
+    void generatePinholeRays8(const CameraSample* samples, std::vector<Ray>& rays) const
+    {
+        Float8 sx, sy;
+        for (int k = 0; k < 8; ++k)
+            sx[k] = samples[k].x, sy[k] = samples[k].y;
+        Vector3f8 p = Vector3f8(corner) + Vector3f8(dxCamera) * sx + Vector3f8(dyCamera) * sy;
+
+        Float8 invLen = Float8(1) / sqrt(dotProduct(p, p));
+        Vector3f8 dir = p * invLen;
+        auto dNormalized = [&](const Vector3f& dp) {
+            return (Vector3f8(dp) - dir * dotProduct(dir, Vector3f8(dp))) * invLen;
+        };
+        Vector3f8 dDdx = dNormalized(dxCamera), dDdy = dNormalized(dyCamera);
+        Float8 coneSpread = sqrt(norm(dDdx) * norm(dDdy));
+
+        for (int k = 0; k < 8; ++k)
+        {
+            Ray& ray = rays.emplace_back(eye, dir.get(k));
+            ray.coneSpread = coneSpread[k];
+            ray.time = samples[k].time;
+        }
+    }
+
+    static void concentricDisk(float u, float v, float& x, float& y)
+    {
+        float a = 2 * u - 1, b = 2 * v - 1;
+        if (a == 0 && b == 0)
+        {
+            x = y = 0;
+            return;
+        }
+        float r, theta;
+        if (std::fabs(a) > std::fabs(b))
+            r = a, theta = M_PI / 4 * (b / a);
+        else
+            r = b, theta = M_PI / 2 - M_PI / 4 * (a / b);
+        x = r * std::cos(theta);
+        y = r * std::sin(theta);
+    }
+
+    Vector3f forward, right, cameraUp;
+    Vector3f corner, dxCamera, dyCamera;
+};
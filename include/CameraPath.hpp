@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include "Camera.hpp"
+
+// A keyframe of a camera animation. Unset fields keep the value of the
+// camera the path is applied to.
+struct CameraKey
+{
+    float frame = 0;
+    std::optional<Vector3f> eye, lookAt, up;
+    std::optional<float> fov;
+};
+
+// Camera animation through keyframes. Positions follow a Catmull-Rom spline
+// through the keys, or straight lines between them; the field of view is
+// always linear. Before the first and after the last key the camera stands
+// still.
+class CameraPath
+{
+public:
+    enum Interpolation { LINEAR, SPLINE };
+    Interpolation interpolation = SPLINE;
+
+    // keeps the keys ordered by frame
+    void add(const CameraKey& key)
+    {
+        auto pos = std::upper_bound(keys.begin(), keys.end(), key.frame,
+                                    [](float f, const CameraKey& k) { return f < k.frame; });
+        keys.insert(pos, key);
+    }
+
+    bool empty() const { return keys.empty(); }
+
+    // base moved to where the path is at frame, updated
+    Camera at(const Camera& base, float frame) const
+    {
+        Camera camera = base;
+        if (!keys.empty())
+        {
+            size_t i = 0; // the key before frame
+            while (i + 2 < keys.size() && keys[i + 1].frame <= frame)
+                ++i;
+            size_t next = std::min(i + 1, keys.size() - 1);
+            float span = keys[next].frame - keys[i].frame;
+            float t = span > 0 ? std::clamp((frame - keys[i].frame) / span, 0.f, 1.f) : 0.f;
+
+            auto point = [&](std::optional<Vector3f> CameraKey::*field, const Vector3f& fallback) {
+                auto value = [&](size_t k) { return (keys[k].*field).value_or(fallback); };
+                if (interpolation == LINEAR)
+                    return lerp(value(i), value(next), t);
+                return catmullRom(value(i > 0 ? i - 1 : i), value(i), value(next),
+                                  value(std::min(next + 1, keys.size() - 1)), t);
+            };
+            camera.eye = point(&CameraKey::eye, base.eye);
+            camera.lookAt = point(&CameraKey::lookAt, base.lookAt);
+            camera.up = normalize(point(&CameraKey::up, base.up));
+            camera.fov = keys[i].fov.value_or(base.fov) * (1 - t) + keys[next].fov.value_or(base.fov) * t;
+        }
+        camera.update();
+        return camera;
+    }
+
+private:
+    // the segment p1 to p2 of the uniform Catmull-Rom spline through p0 .. p3
+    static Vector3f catmullRom(const Vector3f& p0, const Vector3f& p1, const Vector3f& p2,
+                               const Vector3f& p3, float t)
+    {
+        float t2 = t * t, t3 = t2 * t;
+        return 0.5f * (2 * p1 + (p2 - p0) * t + (2 * p0 - 5 * p1 + 4 * p2 - p3) * t2 +
+                       (3 * p1 - p0 - 3 * p2 + p3) * t3);
+    }
+
+    std::vector<CameraKey> keys;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+#include "Vector.hpp"
+
+struct DenoiseOptions
+{
+    int iterations = 0;        // a-trous passes, 0 disables the denoiser
+    float sigmaLuminance = 4;  // in standard deviations of the pixel estimate
+    float sigmaNormal = 128;   // exponent on the cosine between normals
+    float sigmaAlbedo = 0.1f;
+};
+
+// Edge-avoiding a-trous wavelet filter in the spirit of SVGF. The color is
+// divided by the albedo first so textures survive, then smoothed with a 5x5
+// B3 spline kernel of growing stride, where each tap is weighted down by
+// differences in normal, albedo and luminance relative to the remaining
+// noise. variance holds the luminance variance of each pixel's mean and is
+// filtered along with the color.
+void denoise(int width, int height, const std::vector<Vector3f>& color,
+             const std::vector<Vector3f>& albedo, const std::vector<Vector3f>& normal,
+             std::vector<float> variance, const DenoiseOptions& options,
+             std::vector<Vector3f>& result);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AOV.hpp"
+#include "ImageIO.hpp"
+#include "Vector.hpp"
+
+// what a checkpoint needs besides the film to continue a render; the random
+// sequence of every sample is derived from seed, so no generator state has
+// to be stored
+struct RenderProgress
+{
+    uint64_t seed = 0;
+    int spp = 0;         // samples per pixel the render was started with
+    int samplesDone = 0; // samples 0 .. samplesDone-1 are in the film
+    // the part of a distributed render, see RenderOptions
+    int part = 0, parts = 1;
+    int partition = 0;
+    // of the scene and the settings that change the samples, a checkpoint
+    // of anything else can't be continued
+    uint64_t sceneHash = 0;
+};
+
+// Per pixel sums of the radiance and AOVs of all samples taken so far.
+// Sums rather than averages, so a render can be stopped, saved and
+// continued later.
+class Film
+{
+public:
+    explicit Film(int width = 0, int height = 0, uint32_t flags = 0);
+
+    int width() const { return w; }
+    int height() const { return h; }
+    uint32_t aovFlags() const { return flags; }
+
+    void addSample(int index, const Vector3f& L, const AOVSample* aov);
+    // adds the samples of another film of the same size and AOVs
+    bool merge(const Film& other);
+
+    // per pixel averages
+    std::vector<Vector3f> mean(const std::vector<Vector3f>& sums) const;
+    // luminance variance of each pixel's mean, needs AOV_VARIANCE
+    std::vector<float> variance() const;
+
+    // the averaged AOVs in mask as image layers
+    void appendLayers(std::vector<ImageLayer>& layers, uint32_t mask) const;
+
+    // binary dump of all sums, written to a temporary file first so an
+    // interrupted save never destroys the previous checkpoint
+    bool save(const std::string& filename, const RenderProgress& progress) const;
+    // replaces this film, false if the file is missing or malformed
+    bool load(const std::string& filename, RenderProgress& progress);
+
+    std::vector<uint32_t> sampleCount;
+    std::vector<Vector3f> color, albedo, normal, direct, indirect;
+    std::vector<float> depth, materialId, luminance, luminance2;
+    std::vector<uint32_t> hitCount;
+
+private:
+    void allocate();
+
+    int w, h;
+    uint32_t flags;
+};
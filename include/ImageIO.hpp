@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Vector.hpp"
+
+// One named image plane of a render, e.g. the beauty pass or an AOV.
+struct ImageLayer
+{
+    std::string name;        // empty for the beauty pass
+    int channels = 3;        // 1 or 3
+    std::vector<float> data; // interleaved, row-major, top row first
+
+    static ImageLayer fromRGB(const std::string& name, const std::vector<Vector3f>& pixels);
+    static ImageLayer fromGray(const std::string& name, const std::vector<float>& pixels);
+};
+
+struct ExrOptions
+{
+    bool halfFloat = true; // 16-bit half channels instead of 32-bit float
+    bool rle = true;       // RLE compress scanlines
+};
+
+// 8-bit binary PPM, sqrt gamma and clamped to [0, 1]
+bool writePPM(const std::string& filename, int width, int height, const ImageLayer& layer);
+
+// little endian PFM, keeps the full float range
+bool writePFM(const std::string& filename, int width, int height, const ImageLayer& layer);
+
+// reads what writePFM writes, either byte order; false if the file is missing
+// or malformed
+bool readPFM(const std::string& filename, int& width, int& height, ImageLayer& layer);
+
+// single part scanline OpenEXR, a layer named "albedo" becomes the channels
+// albedo.R, albedo.G, albedo.B, the beauty pass plain R, G, B
+bool writeEXR(const std::string& filename, int width, int height,
+              const std::vector<ImageLayer>& layers, const ExrOptions& options = {});
+
+// picks the format from the extension (.ppm, .pfm or .exr). EXR stores all
+// layers in one file, the other formats write the extra layers next to it as
+// <stem>.<layer><ext>.
+bool writeImage(const std::string& filename, int width, int height,
+                const std::vector<ImageLayer>& layers, const ExrOptions& options = {});
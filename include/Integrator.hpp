@@ -0,0 +1,45 @@
+#pragma once
+
+// The light transport variants Scene::castRay is compiled for. Each is a
+// policy type whose settings are constants, so a variant contains no code
+// and no branches for the features it doesn't use.
+enum class IntegratorType
+{
+    PATH,   // path tracing with light sampling at every non-specular hit
+    BSDF,   // path tracing by BSDF sampling only, a reference for PATH
+    DIRECT, // direct light at the first hit only, for quick previews
+};
+
+template <bool DirectLighting, int MaxDepth, bool Aovs>
+struct IntegratorPolicy
+{
+    // sample a light at non-specular hits, emitters found by BSDF sampling
+    // are then skipped to not count them twice
+    static constexpr bool directLighting = DirectLighting;
+    // surface hits per path, 0 leaves the path length to Russian roulette
+    static constexpr int maxDepth = MaxDepth;
+    // fill the AOVSample at the first hit
+    static constexpr bool aovs = Aovs;
+
+    // the policy of the bounces after the first hit
+    using Continuation = IntegratorPolicy<DirectLighting, MaxDepth, false>;
+};
+
+using PathPolicy = IntegratorPolicy<true, 0, false>;
+using BsdfPolicy = IntegratorPolicy<false, 0, false>;
+using DirectPolicy = IntegratorPolicy<true, 1, false>;
+
+// calls f with the policy for type, with or without AOV output
+template <typename F>
+inline decltype(auto) dispatchIntegrator(IntegratorType type, bool aovs, F&& f)
+{
+    switch (type)
+    {
+    case IntegratorType::BSDF:
+        return aovs ? f(IntegratorPolicy<false, 0, true>()) : f(BsdfPolicy());
+    case IntegratorType::DIRECT:
+        return aovs ? f(IntegratorPolicy<true, 1, true>()) : f(DirectPolicy());
+    default:
+        return aovs ? f(IntegratorPolicy<true, 0, true>()) : f(PathPolicy());
+    }
+}
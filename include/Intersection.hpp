@@ -14,6 +14,7 @@ struct Intersection
         distance= std::numeric_limits<double>::max();
         obj =nullptr;
         m=nullptr;
+        uvScale=0;
     }
     bool happened;
     Vector3f coords;
@@ -23,5 +24,15 @@ struct Intersection
     double distance;
     Object* obj;
     Material* m;
+    float uvScale; // texture space length per unit world length around the hit
+};
+
+// What traversal keeps of the closest hit so far. Only the final one is
+// expanded into an Intersection, by Object::getSurface.
+struct HitRecord
+{
+    float t = std::numeric_limits<float>::max();
+    float u = 0, v = 0;    // barycentrics of vertex 1 and 2 on a triangle
+    Object* obj = nullptr; // the primitive hit
 };
 #endif //RAYTRACING_INTERSECTION_H
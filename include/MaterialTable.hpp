@@ -0,0 +1,282 @@
+#pragma once
+
+#include <vector>
+#include "Material.hpp"
+#include "Stats.hpp"
+
+class Object;
+
+// Everything shading needs from a Material, as plain data. Constant textures
+// are folded into kd and ks, so only image textures cost a virtual call.
+struct MaterialRecord
+{
+    MaterialType type;
+    bool emissive;
+    float roughness, ior;
+    float pDiffuse, pSpecular;
+    Vector3f emission;
+    Vector3f kd, ks;
+    const Texture* diffuseMap;  // nullptr if kd is constant
+    const Texture* specularMap; // nullptr if ks is constant
+
+    Vector3f diffuse(const Vector2f& uv, float uvWidth) const
+    {
+        return diffuseMap ? diffuseMap->Evaluate(uv.x, uv.y, uvWidth) : kd;
+    }
+    Vector3f specular(const Vector2f& uv, float uvWidth) const
+    {
+        return specularMap ? specularMap->Evaluate(uv.x, uv.y, uvWidth) : ks;
+    }
+};
+
+// The records of all materials of a scene, indexed by Material::id.
+class MaterialTable
+{
+public:
+    // numbers the materials of objects in order of first use and compiles them
+    void build(const std::vector<Object*>& objects);
+
+    const MaterialRecord& operator[](uint32_t id) const { return records[id]; }
+    size_t size() const { return records.size(); }
+
+    static MaterialRecord compile(const Material& m);
+
+private:
+    std::vector<MaterialRecord> records;
+};
+
+namespace shading
+{
+inline Vector3f reflect(const Vector3f& I, const Vector3f& N)
+{
+    return I - 2 * dotProduct(I, N) * N;
+}
+
+inline float fresnel(const Vector3f& I, const Vector3f& N, float ior)
+{
+    float cosi = clamp(-1, 1, dotProduct(I, N));
+    float etai = 1, etat = ior;
+    if (cosi > 0) { std::swap(etai, etat); }
+    float sint = etai / etat * sqrtf(std::max(0.f, 1 - cosi * cosi));
+    if (sint >= 1)
+        return 1;
+    float cost = sqrtf(std::max(0.f, 1 - sint * sint));
+    cosi = fabsf(cosi);
+    float Rs = ((etat * cosi) - (etai * cost)) / ((etat * cosi) + (etai * cost));
+    float Rp = ((etai * cosi) - (etat * cost)) / ((etai * cosi) + (etat * cost));
+    return (Rs * Rs + Rp * Rp) / 2;
+}
+
+inline Vector3f toWorld(const Vector3f& a, const Vector3f& N)
+{
+    Vector3f B, C;
+    if (std::fabs(N.x) > std::fabs(N.y))
+    {
+        float invLen = 1.0f / std::sqrt(N.x * N.x + N.z * N.z);
+        C = Vector3f(N.z * invLen, 0.0f, -N.x * invLen);
+    }
+    else
+    {
+        float invLen = 1.0f / std::sqrt(N.y * N.y + N.z * N.z);
+        C = Vector3f(0.0f, N.z * invLen, -N.y * invLen);
+    }
+    B = crossProduct(C, N);
+    return a.x * B + a.y * C + a.z * N;
+}
+
+inline Vector3f sampleCosineHemisphere(const Vector3f& N)
+{
+    float x1 = get_random_float(), x2 = get_random_float();
+    float r = sqrtf(x1);
+    float theta = 2 * M_PI * x2;
+    float x = r * cosf(theta);
+    float y = r * sinf(theta);
+    float z = sqrtf(std::max(0.f, 1.0f - x1));
+    return toWorld(Vector3f(x, y, z), N);
+}
+
+inline float cosineHemispherePdf(const Vector3f& wo, const Vector3f& N)
+{
+    float cosTheta = dotProduct(wo, N);
+    return cosTheta > 0.0f ? cosTheta / M_PI : 0.0f;
+}
+
+// GGX NDF
+inline float GGXDistribution(float cosTheta, float alpha)
+{
+    return (alpha * alpha) / (M_PI * pow((alpha * alpha - 1.0f) * cosTheta * cosTheta + 1.0f, 2.0f));
+}
+
+inline Vector3f FresnelSchlick(float cosTheta, const Vector3f& F0)
+{
+    return F0 + (Vector3f(1.0f, 1.0f, 1.0f) - F0) * pow(1.0f - cosTheta, 5.0f);
+}
+
+inline float chiGGX(float v)
+{
+    return (v > 0.0f) ? 1.0f : 0.0f;
+}
+
+inline float GGX_PartialGeometryTerm(const Vector3f& v, const Vector3f& n, const Vector3f& h, float alpha)
+{
+    float VoH = dotProduct(v, h);
+    float chi = chiGGX(VoH / dotProduct(v, n));
+    float VoH2 = VoH * VoH;
+    float tan2 = (1 - VoH2) / VoH2;
+    return (chi * 2.0f) / (1.0f + sqrtf(1.0f + alpha * alpha * tan2));
+}
+}
+
+// The BSDF of one MaterialType. wi points towards the light, wo towards the
+// viewer; sample() picks wi for a given wo.
+template <MaterialType Type>
+struct MaterialKernel;
+
+template <>
+struct MaterialKernel<DIFFUSE>
+{
+    static Vector3f sample(const MaterialRecord&, const Vector3f&, const Vector3f& N)
+    {
+        return shading::sampleCosineHemisphere(N);
+    }
+
+    static float pdf(const MaterialRecord&, const Vector3f&, const Vector3f& wo, const Vector3f& N)
+    {
+        return shading::cosineHemispherePdf(wo, N);
+    }
+
+    static Vector3f eval(const MaterialRecord& m, const Vector3f&, const Vector3f& wo, const Vector3f& N,
+                         const Vector2f& uv, float uvWidth)
+    {
+        if (dotProduct(N, wo) <= 0.0f)
+            return Vector3f(0, 0, 0);
+        return m.diffuse(uv, uvWidth) / M_PI;
+    }
+
+    static Vector3f albedo(const MaterialRecord& m, const Vector2f& uv, float uvWidth)
+    {
+        return m.diffuse(uv, uvWidth);
+    }
+};
+
+// cosine weighted diffuse lobe mixed with a GGX specular lobe
+template <>
+struct MaterialKernel<MICROFACET>
+{
+    static Vector3f sample(const MaterialRecord&, const Vector3f&, const Vector3f& N)
+    {
+        return shading::sampleCosineHemisphere(N);
+    }
+
+    static float pdf(const MaterialRecord& m, const Vector3f& wi, const Vector3f& wo, const Vector3f& N)
+    {
+        float pdfDiffuse = shading::cosineHemispherePdf(wo, N);
+        Vector3f h = normalize(wi + wo);
+        float cosTheta_h = fabs(dotProduct(h, N));
+        float pdfSpecular = 0.0f;
+        if (fabs(dotProduct(wo, h)) > 1e-6)
+            pdfSpecular = shading::GGXDistribution(cosTheta_h, m.roughness) * cosTheta_h /
+                          (4.0f * fabs(dotProduct(wo, h)));
+        return m.pDiffuse * pdfDiffuse + m.pSpecular * pdfSpecular;
+    }
+
+    static Vector3f eval(const MaterialRecord& m, const Vector3f& wi, const Vector3f& wo, const Vector3f& N,
+                         const Vector2f& uv, float uvWidth)
+    {
+        float cosi = std::max(0.f, dotProduct(N, wi));
+        float coso = std::max(0.f, dotProduct(N, wo));
+        if (cosi <= 0.0f || coso <= 0.0f)
+            return Vector3f(0, 0, 0);
+
+        Vector3f diffuse(0), specular(0);
+        if (m.pDiffuse > 1e-8)
+            diffuse = (coso / M_PI) * m.diffuse(uv, uvWidth);
+        if (m.pSpecular > 1e-8)
+        {
+            Vector3f h = normalize(wi + wo);
+            float cosTheta = std::max(0.f, dotProduct(h, N));
+            float D = shading::GGXDistribution(cosTheta, m.roughness);
+            Vector3f F = shading::FresnelSchlick(dotProduct(wi, h), m.specular(uv, uvWidth));
+            float G = shading::GGX_PartialGeometryTerm(wi, N, h, m.roughness);
+            // Cook-Torrance
+            specular = F * ((G * D) / (4.0f * cosi * coso));
+        }
+        return diffuse * m.pDiffuse + specular * m.pSpecular;
+    }
+
+    static Vector3f albedo(const MaterialRecord& m, const Vector2f& uv, float uvWidth)
+    {
+        return m.diffuse(uv, uvWidth);
+    }
+};
+
+// perfect mirror weighted by the dielectric Fresnel term
+template <>
+struct MaterialKernel<DIELECTRIC>
+{
+    static Vector3f sample(const MaterialRecord&, const Vector3f& wi, const Vector3f& N)
+    {
+        return -shading::reflect(wi, N);
+    }
+
+    static float pdf(const MaterialRecord&, const Vector3f&, const Vector3f& wo, const Vector3f& N)
+    {
+        return dotProduct(wo, N) > EPSILON ? 1.0f : 0.0f;
+    }
+
+    static Vector3f eval(const MaterialRecord& m, const Vector3f& wi, const Vector3f& wo, const Vector3f& N,
+                         const Vector2f&, float)
+    {
+        float cosalpha = dotProduct(N, wo);
+        if (cosalpha < 0.001f)
+            return {0.0f};
+        return Vector3f(shading::fresnel(wi, N, m.ior) * (1.f / cosalpha));
+    }
+
+    // dielectrics pass light through untinted
+    static Vector3f albedo(const MaterialRecord&, const Vector2f&, float)
+    {
+        return Vector3f(1);
+    }
+};
+
+// calls f with the kernel of type, so every kernel call inside f is a direct,
+// inlinable call
+template <typename F>
+inline decltype(auto) dispatchMaterial(MaterialType type, F&& f)
+{
+    switch (type)
+    {
+    case MICROFACET:
+        return f(MaterialKernel<MICROFACET>());
+    case DIELECTRIC:
+        return f(MaterialKernel<DIELECTRIC>());
+    default:
+        return f(MaterialKernel<DIFFUSE>());
+    }
+}
+
+inline Vector3f sampleMaterial(const MaterialRecord& m, const Vector3f& wi, const Vector3f& N)
+{
+    STAT_SHADING_TIMER(m.type);
+    return dispatchMaterial(m.type, [&](auto kernel) { return kernel.sample(m, wi, N); });
+}
+
+inline float materialPdf(const MaterialRecord& m, const Vector3f& wi, const Vector3f& wo, const Vector3f& N)
+{
+    STAT_SHADING_TIMER(m.type);
+    return dispatchMaterial(m.type, [&](auto kernel) { return kernel.pdf(m, wi, wo, N); });
+}
+
+inline Vector3f evalMaterial(const MaterialRecord& m, const Vector3f& wi, const Vector3f& wo, const Vector3f& N,
+                             const Vector2f& uv, float uvWidth = 0.f)
+{
+    STAT_SHADING_TIMER(m.type);
+    return dispatchMaterial(m.type, [&](auto kernel) { return kernel.eval(m, wi, wo, N, uv, uvWidth); });
+}
+
+// reflectance used as the albedo AOV
+inline Vector3f materialAlbedo(const MaterialRecord& m, const Vector2f& uv, float uvWidth = 0.f)
+{
+    return dispatchMaterial(m.type, [&](auto kernel) { return kernel.albedo(m, uv, uvWidth); });
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that live as long as a scene. Memory comes from
+// cache line aligned blocks and is handed out in order, so objects created
+// together lie together. Nothing is freed one by one: reset or the destructor
+// destroys all objects, newest first, and releases the blocks at once.
+// Not thread safe.
+class MemoryArena
+{
+public:
+    explicit MemoryArena(size_t blockSize = 256 * 1024) : blockSize(blockSize) {}
+    ~MemoryArena() { reset(); }
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    // uninitialized memory, align must be a power of two up to BlockAlignment
+    void* alloc(size_t bytes, size_t align = alignof(std::max_align_t));
+
+    // constructs a T in the arena, its destructor runs on reset
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        T* p = new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            destructors.push_back({p, [](void* q) { static_cast<T*>(q)->~T(); }});
+        return p;
+    }
+
+    // destroys everything created so far and frees all blocks
+    void reset();
+
+    // block memory held, used or not
+    size_t bytesReserved() const { return reserved; }
+
+    static constexpr size_t BlockAlignment = 64;
+
+private:
+    struct Block
+    {
+        std::byte* data;
+        size_t size;
+    };
+    struct Destructor
+    {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t offset = 0; // first free byte of blocks.back()
+    size_t reserved = 0;
+    std::vector<Destructor> destructors;
+};
@@ -0,0 +1,399 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "TileCache.h"
+#include "Vector.hpp"
+#include "global.hpp"
+
+// How the texels of a mip level are kept in memory. BC1 packs each 4x4 block
+// of RGB into 8 bytes (alpha is dropped), Half16 keeps every channel as an
+// IEEE half.
+enum class TexelFormat { UNorm8, Half16, Float32, BC1 };
+
+// Box filtered mip pyramid of an 8-bit image. Every level is stored in
+// TextureTile::Size square tiles so that a filtered lookup stays within one
+// or two cache lines worth of memory; texels are decoded through the
+// TileCache. The encoded levels stay in memory and count against the cache's
+// memory limit.
+class MipMap
+{
+public:
+    static constexpr int TileSize = TextureTile::Size;
+
+    struct Level
+    {
+        int width, height;
+        int tilesX, tilesY;
+        std::vector<unsigned char> texels; // tile after tile, texelBytes() per texel
+    };
+
+    // pixels are row-major with the first row at the top of the image. With
+    // srgb set the color channels are converted to linear before filtering.
+    MipMap(const unsigned char* pixels, int nx, int ny, int _channel,
+           TexelFormat _format = TexelFormat::UNorm8, bool srgb = false)
+        : channel(_channel), format(_format), id(nextId()++)
+    {
+        int colorChannels = channel == 2 || channel == 4 ? channel - 1 : channel;
+        std::vector<float> cur(size_t(nx) * ny * channel);
+        for (size_t i = 0; i < cur.size(); ++i)
+        {
+            cur[i] = pixels[i] / 255.f;
+            if (srgb && int(i % channel) < colorChannels)
+                cur[i] = srgbToLinear(cur[i]);
+        }
+
+        int w = nx, h = ny;
+        while (true)
+        {
+            addLevel(cur, w, h);
+            if (w == 1 && h == 1)
+                break;
+            int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+            std::vector<float> next(size_t(nw) * nh * channel);
+            for (int y = 0; y < nh; ++y)
+                for (int x = 0; x < nw; ++x)
+                    for (int c = 0; c < channel; ++c)
+                    {
+                        int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                        int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+                        next[(size_t(y) * nw + x) * channel + c] =
+                            0.25f * (cur[(size_t(y0) * w + x0) * channel + c] +
+                                     cur[(size_t(y0) * w + x1) * channel + c] +
+                                     cur[(size_t(y1) * w + x0) * channel + c] +
+                                     cur[(size_t(y1) * w + x1) * channel + c]);
+                    }
+            cur.swap(next);
+            w = nw, h = nh;
+        }
+        TileCache::instance().addEncoded(memoryUsage());
+    }
+
+    ~MipMap()
+    {
+        TileCache::instance().evict(id);
+        TileCache::instance().removeEncoded(memoryUsage());
+    }
+
+    MipMap(const MipMap&) = delete;
+    MipMap& operator=(const MipMap&) = delete;
+
+    int levels() const { return (int)pyramid.size(); }
+    const Level& level(int l) const { return pyramid[l]; }
+    int width() const { return pyramid[0].width; }
+    int height() const { return pyramid[0].height; }
+    uint32_t textureId() const { return id; }
+    TexelFormat texelFormat() const { return format; }
+    // bytes per texel of the uncompressed formats
+    int texelBytes() const
+    {
+        return channel * (format == TexelFormat::Float32 ? 4 : format == TexelFormat::Half16 ? 2 : 1);
+    }
+    size_t tileBytes() const
+    {
+        if (format == TexelFormat::BC1)
+            return (TileSize / 4) * (TileSize / 4) * 8;
+        return size_t(TileSize) * TileSize * texelBytes();
+    }
+    // bytes of the encoded pyramid
+    size_t memoryUsage() const
+    {
+        size_t bytes = 0;
+        for (auto& l : pyramid)
+            bytes += l.texels.size();
+        return bytes;
+    }
+
+    // the decoded tiles of UNorm8 and BC1 are 8-bit, those of the other
+    // formats keep their precision
+    TextureTile::Type tileType() const
+    {
+        return format == TexelFormat::Float32  ? TextureTile::RGBA32F
+               : format == TexelFormat::Half16 ? TextureTile::RGBA16F
+                                               : TextureTile::RGBA8;
+    }
+
+    // expand one tile to RGBA of tileType(), grey images are replicated to
+    // RGB and images without alpha are opaque
+    void decodeTile(uint32_t l, uint32_t tx, uint32_t ty, TextureTile& tile) const
+    {
+        const Level& lv = pyramid[l];
+        const unsigned char* src = &lv.texels[(size_t(ty) * lv.tilesX + tx) * tileBytes()];
+        if (format == TexelFormat::BC1)
+        {
+            constexpr int BlocksPerRow = TileSize / 4;
+            float block[16][3];
+            for (int b = 0; b < BlocksPerRow * BlocksPerRow; ++b, src += 8)
+            {
+                decodeBC1Block(src, block);
+                int bx = b % BlocksPerRow * 4, by = b / BlocksPerRow * 4;
+                for (int i = 0; i < 16; ++i)
+                {
+                    unsigned char* dst = &tile.texels[((by + i / 4) * TileSize + bx + i % 4) * 4];
+                    for (int c = 0; c < 3; ++c)
+                        dst[c] = (unsigned char)std::lround(block[i][c] * 255.f);
+                    dst[3] = 255;
+                }
+            }
+            return;
+        }
+
+        // the encoded channels are copied as they are, only rearranged
+        int size = texelBytes() / channel;
+        int g = channel < 3 ? 0 : 1, b = channel < 3 ? 0 : 2;
+        int a = channel == 2 || channel == 4 ? channel - 1 : -1;
+        unsigned char opaque[4];
+        if (format == TexelFormat::Float32)
+            std::memcpy(opaque, &One32, 4);
+        else if (format == TexelFormat::Half16)
+            std::memcpy(opaque, &One16, 2);
+        else
+            opaque[0] = 255;
+        unsigned char* dst = tile.texels.data();
+        for (int i = 0; i < TileSize * TileSize; ++i, src += texelBytes(), dst += 4 * size)
+        {
+            std::memcpy(dst, src, size);
+            std::memcpy(dst + size, src + g * size, size);
+            std::memcpy(dst + 2 * size, src + b * size, size);
+            std::memcpy(dst + 3 * size, a < 0 ? opaque : src + a * size, size);
+        }
+    }
+
+    // RGBA of an integer texel, coordinates are clamped to the level
+    void texel(int l, int x, int y, float out[4]) const
+    {
+        const Level& lv = pyramid[l];
+        x = std::clamp(x, 0, lv.width - 1);
+        y = std::clamp(y, 0, lv.height - 1);
+        const TextureTile& tile =
+            TileCache::instance().get(*this, l, x / TileSize, y / TileSize);
+        tile.texel(x % TileSize, y % TileSize, out);
+    }
+
+    // bilinear lookup on one level, (s, t) in [0, 1] with t = 0 at the top row
+    void bilinear(int l, float s, float t, float out[4]) const
+    {
+        l = std::clamp(l, 0, levels() - 1);
+        const Level& lv = pyramid[l];
+        float x = s * lv.width - 0.5f, y = t * lv.height - 0.5f;
+        int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+        float dx = x - x0, dy = y - y0;
+        float a[4], b[4], c[4], d[4];
+        texel(l, x0, y0, a);
+        texel(l, x0 + 1, y0, b);
+        texel(l, x0, y0 + 1, c);
+        texel(l, x0 + 1, y0 + 1, d);
+        for (int i = 0; i < 4; ++i)
+            out[i] = (1 - dy) * ((1 - dx) * a[i] + dx * b[i]) + dy * ((1 - dx) * c[i] + dx * d[i]);
+    }
+
+    // trilinear lookup, filterWidth is the footprint in [0, 1] texture space
+    void lookup(float s, float t, float filterWidth, float out[4]) const
+    {
+        float texels = filterWidth * std::max(width(), height());
+        if (texels <= 1.f)
+        {
+            bilinear(0, s, t, out);
+            return;
+        }
+        float lod = std::min(std::log2(texels), float(levels() - 1));
+        int l0 = (int)lod;
+        float f = lod - l0;
+        bilinear(l0, s, t, out);
+        if (f > 0 && l0 + 1 < levels())
+        {
+            float hi[4];
+            bilinear(l0 + 1, s, t, hi);
+            for (int i = 0; i < 4; ++i)
+                out[i] = (1 - f) * out[i] + f * hi[i];
+        }
+    }
+
+private:
+    static float srgbToLinear(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    static std::atomic<uint32_t>& nextId()
+    {
+        static std::atomic<uint32_t> counter{1};
+        return counter;
+    }
+
+    void addLevel(const std::vector<float>& img, int w, int h)
+    {
+        Level lv;
+        lv.width = w, lv.height = h;
+        lv.tilesX = (w + TileSize - 1) / TileSize;
+        lv.tilesY = (h + TileSize - 1) / TileSize;
+        lv.texels.assign(size_t(lv.tilesX) * lv.tilesY * tileBytes(), 0);
+        if (format == TexelFormat::BC1)
+        {
+            // blocks hanging over the image edge repeat the border texels
+            int g = channel < 3 ? 0 : 1, b = channel < 3 ? 0 : 2;
+            constexpr int BlocksPerRow = TileSize / 4;
+            for (int by = 0; by < (h + 3) / 4; ++by)
+                for (int bx = 0; bx < (w + 3) / 4; ++bx)
+                {
+                    float block[16][3];
+                    for (int i = 0; i < 16; ++i)
+                    {
+                        int x = std::min(bx * 4 + i % 4, w - 1), y = std::min(by * 4 + i / 4, h - 1);
+                        const float* src = &img[(size_t(y) * w + x) * channel];
+                        block[i][0] = src[0], block[i][1] = src[g], block[i][2] = src[b];
+                    }
+                    size_t tile = size_t(by * 4 / TileSize) * lv.tilesX + bx * 4 / TileSize;
+                    size_t inTile = (by % BlocksPerRow) * BlocksPerRow + bx % BlocksPerRow;
+                    encodeBC1Block(block, &lv.texels[tile * tileBytes() + inTile * 8]);
+                }
+            pyramid.push_back(std::move(lv));
+            return;
+        }
+
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+            {
+                size_t tile = size_t(y / TileSize) * lv.tilesX + x / TileSize;
+                size_t dst = tile * tileBytes() + ((y % TileSize) * TileSize + x % TileSize) * texelBytes();
+                const float* src = &img[(size_t(y) * w + x) * channel];
+                if (format == TexelFormat::Float32)
+                    std::memcpy(&lv.texels[dst], src, channel * sizeof(float));
+                else if (format == TexelFormat::Half16)
+                    for (int c = 0; c < channel; ++c)
+                    {
+                        uint16_t h16 = floatToHalf(src[c]);
+                        std::memcpy(&lv.texels[dst + 2 * c], &h16, 2);
+                    }
+                else
+                    for (int c = 0; c < channel; ++c)
+                        lv.texels[dst + c] = (unsigned char)std::lround(std::clamp(src[c], 0.f, 1.f) * 255.f);
+            }
+        pyramid.push_back(std::move(lv));
+    }
+
+    static uint16_t packRGB565(const float c[3])
+    {
+        auto q = [](float f, int max) { return (uint16_t)std::lround(std::clamp(f, 0.f, 1.f) * max); };
+        return (q(c[0], 31) << 11) | (q(c[1], 63) << 5) | q(c[2], 31);
+    }
+
+    static void unpackRGB565(uint16_t p, float c[3])
+    {
+        c[0] = ((p >> 11) & 31) / 31.f;
+        c[1] = ((p >> 5) & 63) / 63.f;
+        c[2] = (p & 31) / 31.f;
+    }
+
+    // BC1 in four color mode: endpoints are the extremes of the block along
+    // its principal axis, every texel picks the nearest of the 4 palette colors
+    static void encodeBC1Block(const float block[16][3], unsigned char out[8])
+    {
+        float mean[3] = {0, 0, 0};
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                mean[c] += block[i][c] / 16;
+        float cov[6] = {0, 0, 0, 0, 0, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            float d[3] = {block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2]};
+            cov[0] += d[0] * d[0], cov[1] += d[0] * d[1], cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1], cov[4] += d[1] * d[2], cov[5] += d[2] * d[2];
+        }
+        float axis[3] = {1, 1, 1};
+        for (int it = 0; it < 8; ++it)
+        {
+            float n[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                          cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                          cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+            float len = std::max({std::fabs(n[0]), std::fabs(n[1]), std::fabs(n[2])});
+            if (len < 1e-12f)
+                break;
+            axis[0] = n[0] / len, axis[1] = n[1] / len, axis[2] = n[2] / len;
+        }
+        int lo = 0, hi = 0;
+        float pmin = 1e30f, pmax = -1e30f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float p = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+            if (p < pmin)
+                pmin = p, lo = i;
+            if (p > pmax)
+                pmax = p, hi = i;
+        }
+        uint16_t c0 = packRGB565(block[hi]), c1 = packRGB565(block[lo]);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            float palette[4][3];
+            unpackRGB565(c0, palette[0]);
+            unpackRGB565(c1, palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0;
+                float bestDist = 1e30f;
+                for (int k = 0; k < 4; ++k)
+                {
+                    float d0 = block[i][0] - palette[k][0], d1 = block[i][1] - palette[k][1],
+                          d2 = block[i][2] - palette[k][2];
+                    float dist = d0 * d0 + d1 * d1 + d2 * d2;
+                    if (dist < bestDist)
+                        bestDist = dist, best = k;
+                }
+                indices |= uint32_t(best) << (2 * i);
+            }
+        }
+        out[0] = c0 & 0xff, out[1] = c0 >> 8;
+        out[2] = c1 & 0xff, out[3] = c1 >> 8;
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = (indices >> (8 * i)) & 0xff;
+    }
+
+    static void decodeBC1Block(const unsigned char in[8], float block[16][3])
+    {
+        uint16_t c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+        uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24);
+        float palette[4][3];
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            if (c0 > c1)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            const float* p = palette[(indices >> (2 * i)) & 3];
+            block[i][0] = p[0], block[i][1] = p[1], block[i][2] = p[2];
+        }
+    }
+
+    static constexpr float One32 = 1.f;
+    static constexpr uint16_t One16 = 0x3c00;
+
+    int channel;
+    TexelFormat format;
+    uint32_t id;
+    std::vector<Level> pyramid;
+};
+
+#endif //MIPMAP_H
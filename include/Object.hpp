@@ -15,13 +15,22 @@ public:
     virtual ~Object() {}
     virtual bool intersect(const Ray& ray) = 0;
     virtual bool intersect(const Ray& ray, float &, uint32_t &) const = 0;
-    virtual Intersection getIntersection(Ray _ray) = 0;
+    // records a hit into hit if it lies within [ray.tMin, ray.tMax] and is
+    // no farther than hit.t, returns whether it did
+    virtual bool intersect(const Ray& ray, HitRecord& hit) = 0;
+    // position, normal, uv and material of a hit recorded on this object
+    virtual Intersection getSurface(const Ray& ray, const HitRecord& hit) = 0;
     virtual void getSurfaceProperties(const Vector3f &, const Vector3f &, const uint32_t &, const Vector2f &, Vector3f &, Vector2f &) const = 0;
     virtual Vector3f evalDiffuseColor(const Vector2f &) const =0;
     virtual Bounds3 getBounds()=0;
+    // Objects that move do so linearly over the shutter interval, Ray::time.
+    // getBounds() is their box at shutter open, this one at shutter close.
+    virtual Bounds3 getMotionBounds() { return getBounds(); }
+    virtual bool isMoving() const { return false; }
     virtual float getArea()=0;
     virtual void Sample(Intersection &pos, float &pdf)=0;
     virtual bool hasEmit()=0;
+    virtual Material* getMaterial() const = 0;
 };
 
 
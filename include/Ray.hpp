@@ -1,24 +1,36 @@
 #ifndef RAYTRACING_RAY_H
 #define RAYTRACING_RAY_H
+#include <cstdint>
+#include <limits>
 #include "Vector.hpp"
-struct Ray{
+
+// A ray with what traversal needs precomputed. Only hits at distances in
+// [tMin, tMax] count, every intersector honors the interval, so shortening
+// tMax culls everything beyond it.
+struct alignas(16) Ray{
     //Destination = origin + t*direction
     Vector3f origin;
-    Vector3f direction, direction_inv;
-    double t;//transportation time,
-    double t_min, t_max;
-
-    Ray(const Vector3f& ori, const Vector3f& dir, const double _t = 0.0): origin(ori), direction(dir),t(_t) {
-        direction_inv = Vector3f(1./direction.x, 1./direction.y, 1./direction.z);
-        t_min = 0.0;
-        t_max = std::numeric_limits<double>::max();
+    Vector3f direction;
+    Vector3f direction_inv;
+    float tMin = 0;
+    float tMax = std::numeric_limits<float>::max();
+    // ray cone used for texture filtering: footprint width at the origin and
+    // its growth per unit distance
+    float coneWidth = 0, coneSpread = 0;
+    float time = 0; // in [0, 1), from shutter open to close
+    uint8_t dirIsNeg[3]; // per axis, whether the direction points to -inf
 
+    Ray(const Vector3f& ori, const Vector3f& dir): origin(ori), direction(dir) {
+        direction_inv = rcp(direction);
+        dirIsNeg[0] = direction.x < 0;
+        dirIsNeg[1] = direction.y < 0;
+        dirIsNeg[2] = direction.z < 0;
     }
 
-    Vector3f operator()(double t) const{return origin+direction*t;}
+    Vector3f operator()(float t) const{return origin+direction*t;}
 
     friend std::ostream &operator<<(std::ostream& os, const Ray& r){
-        os<<"[origin:="<<r.origin<<", direction="<<r.direction<<", time="<< r.t<<"]\n";
+        os<<"[origin:="<<r.origin<<", direction="<<r.direction<<", t=["<<r.tMin<<", "<<r.tMax<<"]]\n";
         return os;
     }
 };
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include "Scene.hpp"
+#include "SceneFile.hpp"
+
+// The long running mode of RayTracing, -serve <dir>. Renders the *.job
+// files that appear in a directory, in name order, and keeps every scene
+// they name loaded: a job for a scene seen before skips parsing, mesh and
+// texture loading and the BVH builds. A scene file that changed is loaded
+// anew, the textures only its old version used are freed. The job format is
+// in SceneFile.hpp.
+//
+// A finished job is renamed to <name>.done, a failed one to <name>.failed
+// with the error appended. Write a job under another name and rename it to
+// *.job once complete, or the server may read half of it.
+class RenderServer
+{
+public:
+    explicit RenderServer(std::filesystem::path jobDirectory) : jobDirectory(std::move(jobDirectory)) {}
+
+    // renders the jobs present now, returns how many there were
+    int runPending();
+    // polls for jobs until the process is stopped
+    void run(int pollMilliseconds = 500);
+
+private:
+    struct ResidentScene
+    {
+        SceneDescription desc;
+        std::unique_ptr<Scene> scene;
+        std::filesystem::file_time_type modified;
+    };
+
+    // the loaded scene of file, reloaded if the file changed since; changes
+    // of the meshes it references go unnoticed
+    ResidentScene& getScene(const std::string& file);
+    void runJob(const std::filesystem::path& job);
+
+    std::filesystem::path jobDirectory;
+    std::map<std::string, ResidentScene> scenes;
+};
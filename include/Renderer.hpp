@@ -1,4 +1,8 @@
+#include "Denoiser.hpp"
+#include "Film.hpp"
+#include "ImageIO.hpp"
 #include "Scene.hpp"
+#include "CameraPath.hpp"
 
 #pragma once
 struct hit_payload
@@ -9,11 +13,67 @@ struct hit_payload
     Object* hit_obj;
 };
 
+struct RenderOptions
+{
+    int spp = 32;
+    std::string output = "myTest.ppm"; // the format follows the extension, see writeImage
+    ExrOptions exr;
+    uint32_t aovs = 0; // AOVFlags
+    DenoiseOptions denoise;
+    uint64_t seed = 0; // 0 picks a random seed, unless the render is split into parts
+    IntegratorType integrator = IntegratorType::PATH;
+
+    // renders only part `part` of `parts`, either the sample range
+    // [part * spp / parts, (part + 1) * spp / parts) of every pixel or every
+    // parts-th tile of the image, and writes the film to output for
+    // RayTracingMerge instead of an image
+    enum Partition { SAMPLES, TILES };
+    int part = 0, parts = 1;
+    Partition partition = SAMPLES;
+
+    // the film is saved to checkpoint every checkpointInterval seconds and
+    // once more when the render is done; resume continues from that file
+    std::string checkpoint;
+    int checkpointInterval = 300;
+    bool resume = false;
+    // of the shapes, materials and texture settings, set by loadSceneFile;
+    // a checkpoint only continues a render of the same scene
+    uint64_t sceneHash = 0;
+};
+
 class Renderer
 {
 public:
-    void Render(const Scene& scene);
-    void ompCastRay(const Scene& scene, std::vector<Vector3f> &framebuffer, int start, int end);
+    explicit Renderer(RenderOptions _options = {}) : options(std::move(_options)) {}
+
+    // false if the output couldn't be written
+    bool Render(const Scene& scene);
+    // renders frames [firstFrame, lastFrame] with the camera of path, to the
+    // output and checkpoint names with the frame number inserted (out.0007.exr);
+    // writing a frame overlaps with rendering the next one
+    bool RenderAnimation(Scene& scene, const CameraPath& path, int firstFrame, int lastFrame);
+    // the two halves of Render
+    void RenderFilm(const Scene& scene, Film& film, RenderProgress& progress);
+    bool WriteOutput(const Film& film, const RenderProgress& progress) const;
+    // resolves the film, denoises it if asked to, and writes the image
+    static bool writeFilm(const Film& film, const RenderOptions& options);
+    // takes samples [firstSample, firstSample + count) of rows [start, end)
+    void ompCastRay(const Scene& scene, Film& film, uint64_t seed, int start, int end,
+                    int firstSample, int count);
+    // where sample k of a pixel lies inside it, in [0, 1)^2. Samples are
+    // jittered in a 4x4 grid of strata: every 16 samples cover each stratum
+    // once, in an order whose first 4 cover each quadrant and first 8 each
+    // half of a quadrant, randomly mirrored per pixel so that the mean is the
+    // pixel center for any spp. A function of (seed, pixel, k) alone; the
+    // jitter comes from the sample's random sequence, so this is called right
+    // after seed_random(seed, pixel, k).
+    static Vector2f pixelSample(uint64_t seed, uint32_t pixel, int k);
 private:
-    int spp = 100;
+    static constexpr int PartTileSize = 32;
+    bool ownsPixel(int x, int y, int width) const;
+    // options.sceneHash combined with the camera, integrator and path
+    // settings of this render, stored in checkpoints
+    uint64_t checkpointHash(const Scene& scene) const;
+
+    RenderOptions options;
 };
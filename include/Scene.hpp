@@ -7,6 +7,11 @@
 #include "AreaLight.hpp"
 #include "BVH.hpp"
 #include "Ray.hpp"
+#include "Camera.hpp"
+#include "AOV.hpp"
+#include "Integrator.hpp"
+#include "MaterialTable.hpp"
+#include "MemoryArena.hpp"
 
 
 class Scene
@@ -15,10 +20,15 @@ public:
     // setting up options
     int width = 1280;
     int height = 960;
-    double fov = 40;
+    Camera camera;
     Vector3f backgroundColor = Vector3f(0.235294, 0.67451, 0.843137);
-    int maxDepth = 1;
     float RussianRoulette = 0.8;
+    // minimum spread of the texture filtering ray cone after a non-specular
+    // bounce, in radians
+    float diffuseConeSpread = 0.1f;
+    // whether any object moves while the shutter is open, set by buildBVH
+    // and refitBVH; camera rays then get a random time
+    bool motionBlur = false;
 
     Scene(int w, int h) : width(w), height(h)
     {}
@@ -29,9 +39,27 @@ public:
     const std::vector<Object*>& get_objects() const { return objects; }
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection intersect(const Ray& ray) const;
-    BVHAccel *bvh;
+    // closest hit only, for rays that don't need the surface attributes
+    bool intersect(const Ray& ray, HitRecord& hit) const;
+    BVHAccel *bvh = nullptr;
+    // the flattened materials of all objects, indexed by Material::id
+    MaterialTable materials;
+    // call once all objects are added, also compiles the materials
     void buildBVH();
-    Vector3f castRay(const Ray &ray, int depth) const;
+    // call after objects moved, once the meshes among them are refit
+    // (MeshTriangle::refit); returns whether the BVH was rebuilt
+    bool refitBVH()
+    {
+        bool rebuilt = bvh->Refit();
+        motionBlur = bvh->motion;
+        return rebuilt;
+    }
+    // radiance along ray with the light transport of Policy, see
+    // Integrator.hpp; aov receives the first hit data if Policy::aovs.
+    // Without emission the light emitted at the hit is left out, as the
+    // bounce that spawned the ray already sampled it.
+    template <class Policy>
+    Vector3f castRay(const Ray &ray, int depth, AOVSample *aov = nullptr, bool emission = true) const;
     void sampleLight(Intersection &pos, float &pdf) const;
     bool trace(const Ray &ray, const std::vector<Object*> &objects, float &tNear, uint32_t &index, Object **hitObject);
     std::tuple<Vector3f, Vector3f> HandleAreaLight(const AreaLight &light, const Vector3f &hitPoint, const Vector3f &N,
@@ -39,6 +67,10 @@ public:
                                                    const std::vector<Object *> &objects, uint32_t &index,
                                                    const Vector3f &dir, float specularExponent);
 
+    // owns the objects, their materials and BVHs, everything the scene file
+    // or a loader creates for the scene; all of it goes when the scene does
+    MemoryArena arena;
+
     // creating the scene (adding objects and lights)
     std::vector<Object* > objects;
     std::vector<std::unique_ptr<Light> > lights;
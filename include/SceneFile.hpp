@@ -0,0 +1,109 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+#include "AOV.hpp"
+#include "Camera.hpp"
+#include "CameraPath.hpp"
+#include "Material.hpp"
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include "TextureRegistry.h"
+#include "Vector.hpp"
+
+// Scene description read from a text file, one keyword per line in the
+// spirit of .mtl files; see scenes/ for examples.
+//
+//   resolution <w> <h>        spp <n>              output <file.ppm|pfm|exr>
+//   exrtype half|float        exrcompression none|rle
+//   aov <name>...             albedo normal depth materialid direct indirect variance
+//   denoise <passes>          a-trous passes over the result, 5 is typical
+//   checkpoint <file> [sec]   save the film every sec seconds (default 300)
+//   seed <n>                  fixes the random sequences, 0 for a random seed
+//   integrator path|bsdf|direct   light sampling, BSDF sampling only, or a
+//                             direct light preview; see Integrator.hpp
+//   partition samples|tiles   how -part splits a distributed render
+//   eye <x y z>               lookat <x y z>       up <x y z>      fov <deg>
+//   camera pinhole|thinlens|orthographic
+//   aperture <lens radius>    focusdistance <d>    orthoheight <h>
+//   frames <n>                renders frames 0 .. n-1 of the camera animation,
+//                             output names get the frame number: out.0007.exr
+//   keyframe <frame> [eye <x y z>] [lookat <x y z>] [up <x y z>] [fov <deg>]
+//                             unset values are those of the scene camera
+//   camerapath spline|linear  interpolation of the keyframes, see CameraPath.hpp
+//   russianroulette <p>       conespread <rad>
+//   texturecache <MB>         memory for all textures, encoded and cached tiles
+//   textureformat unorm8|half|float|bc1
+//   texture <file> unorm8|half|float|bc1   storage format of one image file
+//   linearize 0|1
+//   obj <file>                every mesh of the file with its mtl material
+//   mesh <file> <material>    single mesh .obj with a material of this file
+//   sphere <x y z> <r> <material>
+//   move <x y z>              the shape above moves that far while the shutter
+//                             is open, for motion blur; lights can't move
+//   material <name>           starts a material block, creating the material
+//                             or overriding the mtl material of that name:
+//     type diffuse|microfacet|dielectric
+//     kd <r g b>  ks <r g b>  ke <r g b>  roughness <a>  ior <n>
+//
+// Relative paths are resolved against the directory of the scene file.
+//
+// A render job, see RenderServer.hpp, has the same format. It names its
+// scene with `scene <file>` and may change everything but the shapes,
+// materials and texture loading (obj, mesh, sphere, material blocks,
+// textureformat, texture, linearize). Its output is relative to the job file too.
+struct MaterialDesc
+{
+    std::string name;
+    std::optional<MaterialType> type;
+    std::optional<Vector3f> kd, ks, emission;
+    std::optional<float> roughness, ior;
+};
+
+struct ShapeDesc
+{
+    enum Kind { OBJ, MESH, SPHERE };
+    Kind kind = OBJ;
+    std::string path;
+    std::string material;
+    Vector3f center;
+    float radius = 0;
+    Vector3f motion; // over the shutter interval
+};
+
+struct SceneDescription
+{
+    int width = 1280, height = 720;
+    RenderOptions render;
+
+    Camera camera;
+    CameraPath cameraPath;
+    int frames = 0; // 0 renders a still image with camera
+
+    float russianRoulette = 0.8f;
+    float coneSpread = 0.1f;
+    size_t textureCacheMB = 256;
+    TextureLoadOptions textureOptions;
+
+    std::vector<MaterialDesc> materials;
+    std::vector<ShapeDesc> shapes;
+
+    const MaterialDesc* findMaterial(const std::string& name) const;
+};
+
+// throws std::runtime_error with the offending line on malformed input
+SceneDescription loadSceneFile(const std::string& filename);
+
+// the scene file a render job names
+std::string readJobScene(const std::string& jobFile);
+// applies the settings of a render job on top of those of its scene
+void applyJobFile(const std::string& jobFile, SceneDescription& desc);
+
+// "path", "bsdf" or "direct", false for anything else
+bool parseIntegrator(const std::string& name, IntegratorType& type);
+
+// applies the settings of desc to scene and adds all shapes to it
+void buildScene(const SceneDescription& desc, Scene& scene);
+// only the settings: resolution, camera and path sampling parameters
+void applySceneSettings(const SceneDescription& desc, Scene& scene);
@@ -8,13 +8,14 @@
 
 class Sphere : public Object {
 public:
-    Vector3f center;
+    Vector3f center;  // at shutter open
+    Vector3f motion;  // how far the center moves until shutter close
     float radius, radius2;
     Material *m;
     float area;
 
-    Sphere(const Vector3f &c, const float &r, Material *mt = new Material()) : center(c), radius(r), radius2(r * r),
-                                                                               m(mt), area(4 * M_PI * r * r)
+    Sphere(const Vector3f &c, const float &r, Material *mt) : center(c), radius(r), radius2(r * r),
+                                                              m(mt), area(4 * M_PI * r * r)
     {
     }
 
@@ -49,29 +50,33 @@ public:
         return true;
     }
 
-    Intersection getIntersection(Ray ray)
+    Vector3f centerAt(float time) const { return center + motion * time; }
+
+    bool intersect(const Ray &ray, HitRecord &hit)
     {
-        Intersection result;
-        // result.happened = false;
-        Vector3f L = ray.origin - center;
+        Vector3f L = ray.origin - centerAt(ray.time);
         float a = dotProduct(ray.direction, ray.direction);
         float b = 2 * dotProduct(ray.direction, L);
         float c = dotProduct(L, L) - radius2;
         float t0, t1;
-        if (!solveQuadratic(a, b, c, t0, t1)) return result;
-        if (t0 < 0) t0 = t1;
-        if (t0 < 0) return result;
-
-        if (t0 > 0.001)
-        {
-            result.happened = true;
-            result.coords = Vector3f(ray.origin + ray.direction * t0);
-            result.normal = normalize(Vector3f(result.coords - center));
-            result.m = this->m;
-            result.obj = this;
-            result.distance = t0;
-            result.emit = m->getEmission();
-        }
+        if (!solveQuadratic(a, b, c, t0, t1)) return false;
+        if (t0 < ray.tMin) t0 = t1;
+        if (t0 < ray.tMin || t0 <= 0.001 || t0 > std::min(ray.tMax, hit.t)) return false;
+        hit.t = t0;
+        hit.obj = this;
+        return true;
+    }
+
+    Intersection getSurface(const Ray &ray, const HitRecord &hit)
+    {
+        Intersection result;
+        result.happened = true;
+        result.coords = Vector3f(ray.origin + ray.direction * hit.t);
+        result.normal = normalize(Vector3f(result.coords - centerAt(ray.time)));
+        result.m = this->m;
+        result.obj = this;
+        result.distance = hit.t;
+        result.emit = m->getEmission();
         return result;
     }
 
@@ -93,10 +98,20 @@ public:
                        Vector3f(center.x + radius, center.y + radius, center.z + radius));
     }
 
+    Bounds3 getMotionBounds()
+    {
+        Vector3f close = centerAt(1);
+        return Bounds3(close - Vector3f(radius), close + Vector3f(radius));
+    }
+
+    bool isMoving() const { return motion.x != 0 || motion.y != 0 || motion.z != 0; }
+
     void Sample(Intersection &pos, float &pdf)
     {
-        float theta = 2.0 * M_PI * get_random_float(), phi = M_PI * get_random_float();
-        Vector3f dir(std::cos(phi), std::sin(phi) * std::cos(theta), std::sin(phi) * std::sin(theta));
+        // uniform in area: the cosine of the polar angle is uniform in [-1, 1]
+        float theta = 2.0 * M_PI * get_random_float(), cosPhi = 1 - 2 * get_random_float();
+        float sinPhi = std::sqrt(std::max(0.f, 1 - cosPhi * cosPhi));
+        Vector3f dir(cosPhi, sinPhi * std::cos(theta), sinPhi * std::sin(theta));
         pos.coords = center + radius * dir;
         pos.normal = dir;
         pos.emit = m->getEmission();
@@ -112,6 +127,8 @@ public:
     {
         return m->hasEmission();
     }
+
+    Material* getMaterial() const override { return m; }
 };
 
 
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+// Render statistics. Every thread counts into its own RenderStats, so the hot
+// paths only do plain increments; gatherStats() sums them up. Configure with
+// -DRAYTRACING_STATS=OFF to compile all of it out.
+struct RenderStats
+{
+    static constexpr int MaxPathLength = 16; // longer paths share the last bucket
+    static constexpr int MaterialTypes = 3;  // see MaterialType
+
+    uint64_t primaryRays = 0, shadowRays = 0, indirectRays = 0;
+    uint64_t bvhNodesVisited = 0, triangleTests = 0;
+    uint64_t textureLookups = 0, tileCacheMisses = 0;
+    uint64_t shadingCalls[MaterialTypes] = {};
+    uint64_t shadingNanos[MaterialTypes] = {};
+    uint64_t pathLength[MaxPathLength + 1] = {}; // by number of surface hits
+
+    void add(const RenderStats& other);
+};
+
+namespace detail
+{
+// a trivially initialized pointer keeps the hot path free of TLS init guards
+inline thread_local RenderStats* threadStatsPtr = nullptr;
+// creates and registers the counters of the calling thread
+RenderStats& registerThreadStats();
+}
+
+// the calling thread's counters
+inline RenderStats& threadStats()
+{
+    RenderStats* s = detail::threadStatsPtr;
+    return s ? *s : detail::registerThreadStats();
+}
+// zeroes the counters of all threads
+void resetStats();
+// sum over all threads, including ones that already exited
+RenderStats gatherStats();
+void printStats(std::ostream& out, const RenderStats& stats, double seconds);
+
+#ifdef RAYTRACING_STATS
+
+#define STAT_INC(counter) (++threadStats().counter)
+#define STAT_ADD(counter, n) (threadStats().counter += (n))
+#define STAT_PATH_LENGTH(n) (++threadStats().pathLength[std::min<int>((n), RenderStats::MaxPathLength)])
+#define STAT_SHADING_TIMER(type) ShadingTimer shadingTimer_(type)
+
+// counts a shading call of a material type and adds its duration to the
+// shading time. Reading the clock costs about as much as a call, so only
+// every SampleRate-th call is timed and stands in for the others.
+class ShadingTimer
+{
+public:
+    static constexpr uint64_t SampleRate = 16;
+
+    explicit ShadingTimer(int type) : type(type)
+    {
+        timed = threadStats().shadingCalls[type]++ % SampleRate == 0;
+        if (timed)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~ShadingTimer()
+    {
+        if (timed)
+            threadStats().shadingNanos[type] += SampleRate * std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    int type;
+    bool timed;
+    std::chrono::steady_clock::time_point start;
+};
+
+#else
+
+#define STAT_INC(counter) ((void)0)
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_PATH_LENGTH(n) ((void)0)
+#define STAT_SHADING_TIMER(type) ((void)0)
+
+#endif
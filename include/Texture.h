@@ -10,6 +10,10 @@
 class Texture {
 public:
     virtual Vector3f Evaluate(float u, float v) const = 0;
+    // filtered lookup, width is the footprint of the lookup in uv space
+    virtual Vector3f Evaluate(float u, float v, float width) const {
+        return Evaluate(u, v);
+    }
     virtual float EvaluateAlpha(float u, float v) {
         return 1.0;
     }
@@ -0,0 +1,73 @@
+#ifndef TEXTUREREGISTRY_H
+#define TEXTUREREGISTRY_H
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "imageTexture.h"
+
+struct TextureLoadOptions
+{
+    TexelFormat format = TexelFormat::UNorm8;
+    bool linearize = false; // treat images as sRGB and convert to linear
+    // storage format of single files by path, takes precedence over format
+    std::unordered_map<std::string, TexelFormat> formats;
+};
+
+// Loads every image file once and hands out shared handles to it. Names are
+// resolved against the search directory, so materials referring to the same
+// file through different relative paths still share one texture. A file
+// loaded again with other load options becomes a separate texture.
+class TextureRegistry
+{
+public:
+    static TextureRegistry& instance();
+
+    void setSearchPath(const std::string& dir) { searchPath = dir; }
+    void setLoadOptions(const TextureLoadOptions& opts);
+    std::string resolve(const std::string& name) const;
+
+    // nullptr if the image could not be loaded, the failure is only reported
+    // once. Other errors, such as running out of memory, are thrown to every
+    // caller waiting for the image and the next call loads it again.
+    std::shared_ptr<ImageTexture> get(const std::string& name);
+
+    // decode all not yet loaded images in parallel, throws the first error of
+    // get once all are done
+    void preload(const std::vector<std::string>& names);
+
+    // forgets the textures no material holds anymore, freeing them, and the
+    // failed loads, which are tried again on the next get. Call after
+    // dropping a scene; not while textures are loading.
+    void release();
+
+private:
+    using Handle = std::shared_future<std::shared_ptr<ImageTexture>>;
+
+    struct Key
+    {
+        std::string path;
+        TexelFormat format;
+        bool linearize;
+
+        bool operator<(const Key& o) const
+        {
+            return std::tie(path, format, linearize) < std::tie(o.path, o.format, o.linearize);
+        }
+    };
+
+    static std::string canonical(const std::string& path);
+    std::shared_ptr<ImageTexture> load(const Key& key);
+
+    std::mutex mutex;
+    std::map<Key, Handle> textures;
+    std::string searchPath;
+    TextureLoadOptions options;
+};
+
+#endif //TEXTUREREGISTRY_H
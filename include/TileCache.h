@@ -0,0 +1,125 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "global.hpp"
+
+class MipMap;
+
+// Texels of one decoded mip tile, RGBA, row-major inside the tile. They keep
+// the precision of the texture's format: 8-bit for UNorm8 and BC1 textures,
+// half for Half16 and float for Float32 ones, and are expanded to float by
+// each lookup.
+struct TextureTile
+{
+    static constexpr int Size = 64;
+    enum Type { RGBA8, RGBA16F, RGBA32F };
+
+    explicit TextureTile(Type _type) : type(_type), texels(size_t(Size) * Size * texelBytes(_type)) {}
+
+    static int texelBytes(Type type) { return type == RGBA8 ? 4 : type == RGBA16F ? 8 : 16; }
+    size_t bytes() const { return sizeof(TextureTile) + texels.size(); }
+
+    // RGBA of the texel (x, y) of the tile
+    void texel(int x, int y, float out[4]) const
+    {
+        size_t i = size_t(y) * Size + x;
+        if (type == RGBA8)
+        {
+            const unsigned char* t = &texels[i * 4];
+            out[0] = t[0] / 255.f, out[1] = t[1] / 255.f, out[2] = t[2] / 255.f, out[3] = t[3] / 255.f;
+        }
+        else if (type == RGBA16F)
+        {
+            uint16_t t[4];
+            std::memcpy(t, &texels[i * 8], 8);
+            out[0] = halfToFloat(t[0]), out[1] = halfToFloat(t[1]);
+            out[2] = halfToFloat(t[2]), out[3] = halfToFloat(t[3]);
+        }
+        else
+            std::memcpy(out, &texels[i * 16], 16);
+    }
+
+    Type type;
+    std::vector<unsigned char> texels;
+};
+
+struct TileKey
+{
+    uint32_t texture;
+    uint32_t level;
+    uint32_t tx, ty;
+
+    bool operator==(const TileKey& o) const
+    {
+        return texture == o.texture && level == o.level && tx == o.tx && ty == o.ty;
+    }
+};
+
+struct TileKeyHash
+{
+    size_t operator()(const TileKey& k) const
+    {
+        uint64_t h = k.texture;
+        h = h * 0x9e3779b97f4a7c15ull + k.level;
+        h = h * 0x9e3779b97f4a7c15ull + k.tx;
+        h = h * 0x9e3779b97f4a7c15ull + k.ty;
+        return (size_t)(h ^ (h >> 29));
+    }
+};
+
+// Process wide LRU cache of decoded texture tiles with a memory cap. Every
+// thread first checks a small private table of recently used tiles, so the
+// locked shards are only touched when a thread moves to a new tile.
+//
+// The memory limit covers all texture memory: the encoded pyramids of the
+// live MipMaps, which stay resident, and the decoded tiles, which get what
+// the pyramids leave of it.
+class TileCache
+{
+public:
+    static TileCache& instance();
+
+    // total bytes of encoded pyramids and of decoded tiles kept alive by the
+    // shared cache. With pyramids over the limit the cache still keeps a tile
+    // per shard; the private tables keep up to 32 more tiles per thread.
+    void setMemoryLimit(size_t bytes);
+    size_t memoryLimit() const { return limit; }
+
+    // bytes of encoded pyramids, kept up to date by MipMap
+    void addEncoded(size_t bytes) { encoded += bytes; }
+    void removeEncoded(size_t bytes) { encoded -= bytes; }
+    size_t encodedBytes() const { return encoded; }
+
+    const TextureTile& get(const MipMap& mip, uint32_t level, uint32_t tx, uint32_t ty);
+
+    // drop all tiles of a texture, called when its MipMap goes away
+    void evict(uint32_t texture);
+
+private:
+    static constexpr int NumShards = 16;
+
+    struct Shard
+    {
+        using Entry = std::pair<TileKey, std::shared_ptr<const TextureTile>>;
+        std::mutex mutex;
+        std::list<Entry> lru; // most recently used at the front
+        std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> map;
+        size_t bytes = 0;
+    };
+
+    std::shared_ptr<const TextureTile> fetch(const MipMap& mip, const TileKey& key, size_t hash);
+
+    Shard shards[NumShards];
+    size_t limit = size_t(256) << 20;
+    std::atomic<size_t> encoded{0};
+};
+
+#endif //TILECACHE_H
@@ -5,11 +5,12 @@
 #include "Material.hpp"
 #include "OBJ_Loader.hpp"
 #include "Object.hpp"
+#include "Stats.hpp"
 #include <cassert>
 #include <array>
 #include <unordered_map>
 
-bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1,
+inline bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1,
                           const Vector3f& v2, const Vector3f& orig,
                           const Vector3f& dir, float& tnear, float& u, float& v)
 {
@@ -39,37 +40,46 @@ bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1,
     return true;
 }
 
+class MeshTriangle;
+
+// A single face of a MeshTriangle. The vertex positions and texture coords
+// live in the shared buffers of the owning mesh, a Triangle only keeps the
+// index of its vertex triple.
 class Triangle : public Object
 {
 public:
-    Vector3f v0, v1, v2; // vertices A, B ,C , counter-clockwise order
-    Vector3f e1, e2; // 2 edges v1-v0, v2-v0;
-    Vector2f t0, t1, t2; // texture coords
-    Vector3f normal;
+    const MeshTriangle* mesh; // owning mesh, holds the vertex buffers
+    uint32_t index;           // face index into mesh->vertexIndex
     float area;
     Material* m;
 
-    Triangle(Vector3f _v0, Vector3f _v1, Vector3f _v2, Vector2f _t0, Vector2f _t1, Vector2f _t2, Material* _m = nullptr)
-        : v0(_v0), v1(_v1), v2(_v2), t0(_t0), t1(_t1), t2(_t2), m(_m)
-    {
-        e1 = v1 - v0;
-        e2 = v2 - v0;
-        normal = normalize(crossProduct(e1, e2));
-        area = crossProduct(e1, e2).norm() * 0.5f;
-    }
+    inline Triangle(const MeshTriangle* _mesh, uint32_t _index, Material* _m = nullptr);
+    // recomputes area from the vertices
+    inline void updateArea();
+
+    // vertices A, B ,C , counter-clockwise order
+    inline const Vector3f& vertex(int k) const;
+    // position of vertex k at time in the shutter interval
+    inline Vector3f vertexAt(int k, float time) const;
+    inline const Vector2f& stCoord(int k) const;
+    inline Vector3f faceNormal() const;
+    // interpolated vertex normal at barycentrics (u, v), the face normal
+    // when the mesh has none
+    inline Vector3f shadingNormal(float u, float v) const;
 
     bool intersect(const Ray& ray) override;
 
     bool intersect(const Ray& ray, float& tnear,
                    uint32_t& index) const override;
 
-    Intersection getIntersection(Ray ray) override;
+    bool intersect(const Ray& ray, HitRecord& hit) override;
+    Intersection getSurface(const Ray& ray, const HitRecord& hit) override;
 
     void getSurfaceProperties(const Vector3f& P, const Vector3f& I,
                               const uint32_t& index, const Vector2f& uv,
                               Vector3f& N, Vector2f& st) const override
     {
-        N = normal;
+        N = faceNormal();
         //        throw std::runtime_error("triangle::getSurfaceProperties not
         //        implemented.");
     }
@@ -77,14 +87,10 @@ public:
     Vector3f evalDiffuseColor(const Vector2f&) const override;
 
     Bounds3 getBounds() override;
+    Bounds3 getMotionBounds() override;
+    inline bool isMoving() const override;
 
-    void Sample(Intersection& pos, float& pdf)
-    {
-        float x = std::sqrt(get_random_float()), y = get_random_float();
-        pos.coords = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);
-        pos.normal = this->normal;
-        pdf = 1.0f / area;
-    }
+    inline void Sample(Intersection& pos, float& pdf) override;
 
     float getArea()
     {
@@ -95,98 +101,37 @@ public:
     {
         return m->hasEmission();
     }
+
+    Material* getMaterial() const override { return m; }
 };
 
 class MeshTriangle : public Object
 {
 public:
-    MeshTriangle(const std::string& filename, Material* default_mt = new Material())
+    // the mesh BVH, and the material of an objl mesh, are created in arena
+    MeshTriangle(MemoryArena& arena, const std::string& filename, Material* mt)
     {
         objl::Loader loader;
         loader.LoadFile(filename);
-        area = 0;
-        m = default_mt;
         assert(loader.LoadedMeshes.size() == 1);
         auto mesh = loader.LoadedMeshes[0];
 
-        Vector3f min_vert = Vector3f{std::numeric_limits<float>::infinity(),
-                                     std::numeric_limits<float>::infinity(),
-                                     std::numeric_limits<float>::infinity()};
-        Vector3f max_vert = Vector3f{-std::numeric_limits<float>::infinity(),
-                                     -std::numeric_limits<float>::infinity(),
-                                     -std::numeric_limits<float>::infinity()};
-        for (size_t i = 0; i < mesh.Vertices.size(); i += 3)
-        {
-            std::array<Vector3f, 3> face_vertices;
-            std::array<Vector2f, 3> face_textures;
-
-            for (int j = 0; j < 3; j++)
-            {
-                auto vert = Vector3f(mesh.Vertices[i + j].Position.X,
-                                     mesh.Vertices[i + j].Position.Y,
-                                     mesh.Vertices[i + j].Position.Z);
-                auto text = Vector2f(mesh.Vertices[i + j].TextureCoordinate.X,
-                                     mesh.Vertices[i + j].TextureCoordinate.Y);
-                face_vertices[j] = vert;
-                face_textures[j] = text;
-
-                min_vert.x = std::min(min_vert.x, vert.x);
-                min_vert.y = std::min(min_vert.y, vert.y);
-                min_vert.z = std::min(min_vert.z, vert.z);
-
-                max_vert.x = std::max(max_vert.x, vert.x);
-                max_vert.y = std::max(max_vert.y, vert.y);
-                max_vert.z = std::max(max_vert.z, vert.z);
-            }
-
-            triangles.emplace_back(face_vertices[0], face_vertices[1], face_vertices[2],
-                                   face_textures[0], face_textures[1], face_textures[2],
-                                   default_mt);
-        }
-
-        bounding_box = Bounds3(min_vert, max_vert);
-
-        std::vector<Object*> ptrs;
-        for (auto& tri : triangles){
-            ptrs.push_back(&tri);
-            area += tri.area;
-        }
-        bvh = new BVHAccel(ptrs);
+        m = mt;
+        loadMesh(arena, mesh);
     }
 
-    MeshTriangle(objl::Mesh mesh, Vector3f emission = {0})
+    MeshTriangle(MemoryArena& arena, objl::Mesh mesh, Vector3f emission = {0})
     {
-        // objl::Loader loader;
-        // loader.LoadFile(filename);
-
-        area = 0;
-        // m = default_mt;
-
-        // init bounding box
-        Vector3f min_vert = Vector3f{
-            std::numeric_limits<float>::infinity(),
-            std::numeric_limits<float>::infinity(),
-            std::numeric_limits<float>::infinity()
-        };
-        Vector3f max_vert = Vector3f{
-            -std::numeric_limits<float>::infinity(),
-            -std::numeric_limits<float>::infinity(),
-            -std::numeric_limits<float>::infinity()
-        };
-
-        // clear triangles
-        triangles.clear();
-
         Material* meshMaterial = nullptr;
         if (mesh.MeshMaterial.has_value())
         {
-            meshMaterial = new Material(mesh.MeshMaterial.value());
+            meshMaterial = arena.create<Material>(mesh.MeshMaterial.value());
             meshMaterial->setEmission(emission);
         }
         else
-            meshMaterial = new Material(MICROFACET, {0});
+            meshMaterial = arena.create<Material>(MICROFACET, Vector3f(0));
 
-        if (mesh.MeshMaterial.value().Ns > 200)
+        if (mesh.MeshMaterial.has_value() && mesh.MeshMaterial.value().Ns > 200)
         {
             // std::cout << "--------------------name: " << meshMaterial->matName.value() << std::endl;
             assert(meshMaterial->m_type == DIELECTRIC);
@@ -198,49 +143,30 @@ public:
         // meshMaterial->roughness = 0.05;
 
         m = meshMaterial;
+        loadMesh(arena, mesh);
+    }
 
-        for (size_t i = 0; i < mesh.Vertices.size(); i += 3)
-        {
-            std::array<Vector3f, 3> face_vertices;
-            std::array<Vector2f, 3> face_textures;
-
-            for (int j = 0; j < 3; j++)
-            {
-                auto vert = Vector3f(mesh.Vertices[i + j].Position.X,
-                                     mesh.Vertices[i + j].Position.Y,
-                                     mesh.Vertices[i + j].Position.Z);
-                auto text = Vector2f(mesh.Vertices[i + j].TextureCoordinate.X,
-                                     mesh.Vertices[i + j].TextureCoordinate.Y);
-                face_vertices[j] = vert;
-                face_textures[j] = text;
-
-                min_vert.x = std::min(min_vert.x, vert.x);
-                min_vert.y = std::min(min_vert.y, vert.y);
-                min_vert.z = std::min(min_vert.z, vert.z);
-
-                max_vert.x = std::max(max_vert.x, vert.x);
-                max_vert.y = std::max(max_vert.y, vert.y);
-                max_vert.z = std::max(max_vert.z, vert.z);
-            }
-
-            triangles.emplace_back(face_vertices[0], face_vertices[1], face_vertices[2],
-                                   face_textures[0], face_textures[1], face_textures[2],
-                                   meshMaterial);
-        }
-
-
-        bounding_box = Bounds3(min_vert, max_vert);
 
-        std::vector<Object*> ptrs;
+    // call after changing vertices or verticesClose: updates the bounds, the areas and the
+    // mesh BVH, see BVHAccel::Refit; returns whether the BVH was rebuilt
+    bool refit(float maxCostIncrease = BVHAccel::DefaultMaxCostIncrease)
+    {
+        Bounds3 box, boxClose;
+        for (auto& vert : vertices)
+            box = Union(box, vert);
+        for (auto& vert : verticesClose)
+            boxClose = Union(boxClose, vert);
+        bounding_box = box;
+        bounding_box_close = boxClose;
+        area = 0;
         for (auto& tri : triangles)
         {
-            ptrs.push_back(&tri);
+            tri.updateArea();
             area += tri.area;
         }
-        bvh = new BVHAccel(ptrs);
+        return bvh->Refit(maxCostIncrease);
     }
 
-
     bool intersect(const Ray& ray) { return true; }
 
     bool intersect(const Ray& ray, float& tnear, uint32_t& index) const
@@ -266,6 +192,17 @@ public:
     }
 
     Bounds3 getBounds() { return bounding_box; }
+    Bounds3 getMotionBounds() { return verticesClose.empty() ? bounding_box : bounding_box_close; }
+    bool isMoving() const { return !verticesClose.empty(); }
+
+    // moves the whole mesh by offset over the shutter interval
+    void setMotion(const Vector3f& offset)
+    {
+        verticesClose.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+            verticesClose[i] = vertices[i] + offset;
+        refit();
+    }
 
     void getSurfaceProperties(const Vector3f& P, const Vector3f& I,
                               const uint32_t& index, const Vector2f& uv,
@@ -292,16 +229,15 @@ public:
                     Vector3f(0.937, 0.937, 0.231), pattern);
     }
 
-    Intersection getIntersection(Ray ray)
+    bool intersect(const Ray& ray, HitRecord& hit) override
     {
-        Intersection intersec;
-
-        if (bvh)
-        {
-            intersec = bvh->Intersect(ray);
-        }
+        return bvh && bvh->Intersect(ray, hit);
+    }
 
-        return intersec;
+    // hits record the triangle, not the mesh
+    Intersection getSurface(const Ray& ray, const HitRecord& hit) override
+    {
+        return hit.obj->getSurface(ray, hit);
     }
 
     void Sample(Intersection& pos, float& pdf)
@@ -320,20 +256,196 @@ public:
         return m->hasEmission();
     }
 
+    Material* getMaterial() const override { return m; }
+
     Bounds3 bounding_box;
-    std::unique_ptr<Vector3f[]> vertices;
+    Bounds3 bounding_box_close; // of verticesClose
+    // shared vertex buffers, each unique (position, texcoord, normal) is stored once
+    std::vector<Vector3f> vertices;
+    // positions at shutter close, see Object::getMotionBounds; empty if the
+    // mesh doesn't move
+    std::vector<Vector3f> verticesClose;
+    std::vector<Vector2f> stCoordinates;
+    // octahedral encoded shading normals, empty for flat shaded meshes
+    std::vector<uint32_t> normals;
     uint32_t numTriangles;
-    std::unique_ptr<uint32_t[]> vertexIndex;
-    std::unique_ptr<Vector2f[]> stCoordinates;
+    // 3 indices per triangle into the buffers above
+    std::vector<uint32_t> vertexIndex;
 
     std::vector<Triangle> triangles;
 
-    BVHAccel* bvh;
+    BVHAccel* bvh = nullptr;
     float area;
 
     Material* m;
+
+private:
+    struct VertexKey
+    {
+        float px, py, pz, u, v, nx, ny, nz;
+
+        bool operator==(const VertexKey& o) const
+        {
+            return px == o.px && py == o.py && pz == o.pz && u == o.u && v == o.v &&
+                   nx == o.nx && ny == o.ny && nz == o.nz;
+        }
+    };
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey& k) const
+        {
+            std::hash<float> h;
+            size_t seed = 0;
+            for (float f : {k.px, k.py, k.pz, k.u, k.v, k.nx, k.ny, k.nz})
+                seed ^= h(f) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            return seed;
+        }
+    };
+
+    // objl fills in the face normal for faces without vn, so a mesh only has
+    // real vertex normals if some face has differing normals at its corners
+    static bool hasVertexNormals(const objl::Mesh& mesh)
+    {
+        for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+        {
+            const objl::Vector3& n0 = mesh.Vertices[mesh.Indices[i]].Normal;
+            const objl::Vector3& n1 = mesh.Vertices[mesh.Indices[i + 1]].Normal;
+            const objl::Vector3& n2 = mesh.Vertices[mesh.Indices[i + 2]].Normal;
+            if (!(n0 == n1) || !(n0 == n2))
+                return true;
+        }
+        return false;
+    }
+
+    // objl hands out one vertex per face corner, weld identical corners back
+    // together and build the triangles from the index list
+    void loadMesh(MemoryArena& arena, const objl::Mesh& mesh)
+    {
+        area = 0;
+
+        // init bounding box
+        Vector3f min_vert = Vector3f{
+            std::numeric_limits<float>::infinity(),
+            std::numeric_limits<float>::infinity(),
+            std::numeric_limits<float>::infinity()
+        };
+        Vector3f max_vert = Vector3f{
+            -std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity()
+        };
+
+        bool smooth = hasVertexNormals(mesh);
+
+        std::unordered_map<VertexKey, uint32_t, VertexKeyHash> welded;
+        welded.reserve(mesh.Vertices.size());
+        std::vector<uint32_t> remap(mesh.Vertices.size());
+        for (size_t i = 0; i < mesh.Vertices.size(); ++i)
+        {
+            const objl::Vertex& vt = mesh.Vertices[i];
+            VertexKey key{vt.Position.X, vt.Position.Y, vt.Position.Z,
+                          vt.TextureCoordinate.X, vt.TextureCoordinate.Y, 0, 0, 0};
+            if (smooth)
+            {
+                key.nx = vt.Normal.X;
+                key.ny = vt.Normal.Y;
+                key.nz = vt.Normal.Z;
+            }
+            auto [it, inserted] = welded.emplace(key, (uint32_t)vertices.size());
+            if (inserted)
+            {
+                auto vert = Vector3f(key.px, key.py, key.pz);
+                vertices.push_back(vert);
+                stCoordinates.emplace_back(key.u, key.v);
+                if (smooth)
+                    normals.push_back(encodeOctNormal(normalize(Vector3f(key.nx, key.ny, key.nz))));
+
+                min_vert = Vector3f::Min(min_vert, vert);
+                max_vert = Vector3f::Max(max_vert, vert);
+            }
+            remap[i] = it->second;
+        }
+
+        numTriangles = mesh.Indices.size() / 3;
+        vertexIndex.resize(numTriangles * 3);
+        for (size_t i = 0; i < vertexIndex.size(); ++i)
+            vertexIndex[i] = remap[mesh.Indices[i]];
+
+        bounding_box = Bounds3(min_vert, max_vert);
+
+        // triangles must not reallocate once the BVH holds pointers into it
+        triangles.reserve(numTriangles);
+        for (uint32_t k = 0; k < numTriangles; ++k)
+            triangles.emplace_back(this, k, m);
+
+        std::vector<Object*> ptrs;
+        for (auto& tri : triangles)
+        {
+            ptrs.push_back(&tri);
+            area += tri.area;
+        }
+        bvh = arena.create<BVHAccel>(ptrs);
+    }
 };
 
+Triangle::Triangle(const MeshTriangle* _mesh, uint32_t _index, Material* _m)
+    : mesh(_mesh), index(_index), m(_m)
+{
+    updateArea();
+}
+
+void Triangle::updateArea()
+{
+    area = crossProduct(vertex(1) - vertex(0), vertex(2) - vertex(0)).norm() * 0.5f;
+}
+
+const Vector3f& Triangle::vertex(int k) const
+{
+    return mesh->vertices[mesh->vertexIndex[index * 3 + k]];
+}
+
+Vector3f Triangle::vertexAt(int k, float time) const
+{
+    if (mesh->verticesClose.empty())
+        return vertex(k);
+    return lerp(vertex(k), mesh->verticesClose[mesh->vertexIndex[index * 3 + k]], time);
+}
+
+bool Triangle::isMoving() const
+{
+    return !mesh->verticesClose.empty();
+}
+
+const Vector2f& Triangle::stCoord(int k) const
+{
+    return mesh->stCoordinates[mesh->vertexIndex[index * 3 + k]];
+}
+
+Vector3f Triangle::faceNormal() const
+{
+    return normalize(crossProduct(vertex(1) - vertex(0), vertex(2) - vertex(0)));
+}
+
+Vector3f Triangle::shadingNormal(float u, float v) const
+{
+    if (mesh->normals.empty())
+        return faceNormal();
+    const uint32_t* idx = &mesh->vertexIndex[index * 3];
+    Vector3f n = decodeOctNormal(mesh->normals[idx[0]]) * (1 - u - v) +
+                 decodeOctNormal(mesh->normals[idx[1]]) * u +
+                 decodeOctNormal(mesh->normals[idx[2]]) * v;
+    return normalize(n);
+}
+
+void Triangle::Sample(Intersection& pos, float& pdf)
+{
+    float x = std::sqrt(get_random_float()), y = get_random_float();
+    pos.coords = vertex(0) * (1.0f - x) + vertex(1) * (x * (1.0f - y)) + vertex(2) * (x * y);
+    pos.normal = faceNormal();
+    pdf = 1.0f / area;
+}
+
 inline bool Triangle::intersect(const Ray& ray) { return true; }
 
 inline bool Triangle::intersect(const Ray& ray, float& tnear,
@@ -342,47 +454,90 @@ inline bool Triangle::intersect(const Ray& ray, float& tnear,
     return false;
 }
 
-inline Bounds3 Triangle::getBounds() { return Union(Bounds3(v0, v1), v2); }
+inline Bounds3 Triangle::getBounds() { return Union(Bounds3(vertex(0), vertex(1)), vertex(2)); }
 
-inline Intersection Triangle::getIntersection(Ray ray)
+inline Bounds3 Triangle::getMotionBounds()
 {
-    Intersection inter;
+    return isMoving() ? Union(Bounds3(vertexAt(0, 1), vertexAt(1, 1)), vertexAt(2, 1)) : getBounds();
+}
+
+inline bool Triangle::intersect(const Ray& ray, HitRecord& hit)
+{
+    STAT_INC(triangleTests);
+    Vector3f v0, e1, e2;
+    if (isMoving())
+    {
+        v0 = vertexAt(0, ray.time);
+        e1 = vertexAt(1, ray.time) - v0;
+        e2 = vertexAt(2, ray.time) - v0;
+    }
+    else
+    {
+        v0 = vertex(0);
+        e1 = vertex(1) - v0;
+        e2 = vertex(2) - v0;
+    }
 
-    if (dotProduct(ray.direction, normal) > 0)
-        return inter;
-    double u, v, t_tmp = 0;
+    // The dot and cross products are float. Only the divisions by det are
+    // done in double, so u, v and t carry the rounding of their float
+    // numerators but no second one from the division.
     Vector3f pvec = crossProduct(ray.direction, e2);
+    // det = -dot(dir, e1 x e2) is positive when the ray meets the front of
+    // the triangle; back faces are culled, as the original intersector did
+    // with its dot(dir, normal) > 0 test. |det| <= |e1| |e2|, with equality
+    // for a ray along the normal, and the test for a ray parallel to the
+    // triangle or a degenerate triangle is relative to that so that it
+    // doesn't depend on the scene's scale
     double det = dotProduct(e1, pvec);
-    if (fabs(det) < EPSILON)
-        return inter;
+    if (det <= 0 || det * det <= 1e-12 * dotProduct(e1, e1) * dotProduct(e2, e2))
+        return false;
 
     double det_inv = 1. / det;
     Vector3f tvec = ray.origin - v0;
-    u = dotProduct(tvec, pvec) * det_inv;
+    double u = dotProduct(tvec, pvec) * det_inv;
     if (u < 0 || u > 1)
-        return inter;
+        return false;
     Vector3f qvec = crossProduct(tvec, e1);
-    v = dotProduct(ray.direction, qvec) * det_inv;
+    double v = dotProduct(ray.direction, qvec) * det_inv;
     if (v < 0 || u + v > 1)
-        return inter;
-    t_tmp = dotProduct(e2, qvec) * det_inv;
-    if (t_tmp < 0)
-        return inter;
+        return false;
+    double t = dotProduct(e2, qvec) * det_inv;
+    // on a tie the primitive tested last wins
+    if (t < ray.tMin || t > std::min(ray.tMax, hit.t))
+        return false;
 
-    // TODO find ray triangle intersection
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    hit.obj = this;
+    return true;
+}
+
+inline Intersection Triangle::getSurface(const Ray& ray, const HitRecord& hit)
+{
+    Intersection inter;
     inter.happened = true;
-    inter.coords = ray(t_tmp);
-    inter.distance = t_tmp;
+    inter.coords = ray(hit.t);
+    inter.distance = hit.t;
     inter.obj = this;
-    inter.normal = normal;
+    Vector3f v0 = vertexAt(0, ray.time);
+    Vector3f geoNormal = normalize(crossProduct(vertexAt(1, ray.time) - v0, vertexAt(2, ray.time) - v0));
+    inter.normal = geoNormal;
+    if (!mesh->normals.empty())
+    {
+        // keep the shading normal on the same side as the geometry
+        Vector3f shading = shadingNormal(hit.u, hit.v);
+        if (dotProduct(shading, geoNormal) > 0)
+            inter.normal = shading;
+    }
     inter.m = m;
     inter.emit = m->getEmission();
 
-    float w = 1 - u - v;
-    // 假设 Triangle 类中有成员 uv0, uv1, uv2（类型 Vector2f）
-    inter.tcoords = t0 * w + t1 * u + t2 * v;
-
-    return inter;
+    float w = 1 - hit.u - hit.v;
+    const Vector2f &st0 = stCoord(0), &st1 = stCoord(1), &st2 = stCoord(2);
+    inter.tcoords = st0 * w + st1 * hit.u + st2 * hit.v;
+    float stArea = 0.5f * std::fabs((st1.x - st0.x) * (st2.y - st0.y) - (st2.x - st0.x) * (st1.y - st0.y));
+    inter.uvScale = area > 0 ? std::sqrt(stArea / area) : 0;
 
     return inter;
 }
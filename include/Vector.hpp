@@ -5,48 +5,109 @@
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <cstdint>
 
-class Vector3f {
-public:
-    float x, y, z;
-    Vector3f() : x(0), y(0), z(0) {}
-    Vector3f(float xx) : x(xx), y(xx), z(xx) {}
-    Vector3f(float xx, float yy, float zz) : x(xx), y(yy), z(zz) {}
-    Vector3f operator * (const float &r) const { return Vector3f(x * r, y * r, z * r); }
-    Vector3f operator / (const float &r) const { return Vector3f(x / r, y / r, z / r); }
-
-    float norm() {return std::sqrt(x * x + y * y + z * z);}
-    Vector3f normalized() {
-        float n = std::sqrt(x * x + y * y + z * z);
-        return Vector3f(x / n, y / n, z / n);
-    }
+#if defined(__SSE2__) || defined(_M_X64)
+#define RAYTRACING_SSE
+#include <emmintrin.h>
+#endif
+
+// The 4-lane operations Vector3f is built on, SSE when available, plain
+// floats otherwise. min and max return a for unordered inputs like
+// std::min and std::max do.
+namespace simd
+{
+#ifdef RAYTRACING_SSE
+using float4 = __m128;
+inline float4 set(float x, float y, float z) { return _mm_set_ps(0, z, y, x); }
+inline float4 splat(float f) { return _mm_set1_ps(f); }
+inline float4 add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 div(float4 a, float4 b) { return _mm_div_ps(a, b); }
+inline float4 min(float4 a, float4 b) { return _mm_min_ps(b, a); }
+inline float4 max(float4 a, float4 b) { return _mm_max_ps(b, a); }
+inline float4 neg(float4 a) { return _mm_xor_ps(a, _mm_set1_ps(-0.f)); }
+// (y, z, x)
+inline float4 yzx(float4 a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)); }
+// x + y + z, in that order
+inline float sum3(float4 a)
+{
+    __m128 xy = _mm_add_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(_mm_add_ss(xy, _mm_movehl_ps(a, a)));
+}
+inline float min3(float4 a)
+{
+    __m128 xy = _mm_min_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(_mm_min_ss(xy, _mm_movehl_ps(a, a)));
+}
+inline float max3(float4 a)
+{
+    __m128 xy = _mm_max_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(_mm_max_ss(xy, _mm_movehl_ps(a, a)));
+}
+#else
+struct float4 { float v[4]; };
+inline float4 set(float x, float y, float z) { return {{x, y, z, 0}}; }
+inline float4 splat(float f) { return {{f, f, f, f}}; }
+template <typename Op>
+inline float4 lanes(float4 a, float4 b, Op op)
+{ return {{op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3])}}; }
+inline float4 add(float4 a, float4 b) { return lanes(a, b, [](float p, float q) { return p + q; }); }
+inline float4 sub(float4 a, float4 b) { return lanes(a, b, [](float p, float q) { return p - q; }); }
+inline float4 mul(float4 a, float4 b) { return lanes(a, b, [](float p, float q) { return p * q; }); }
+inline float4 div(float4 a, float4 b) { return lanes(a, b, [](float p, float q) { return p / q; }); }
+inline float4 min(float4 a, float4 b) { return lanes(a, b, [](float p, float q) { return std::min(p, q); }); }
+inline float4 max(float4 a, float4 b) { return lanes(a, b, [](float p, float q) { return std::max(p, q); }); }
+inline float4 neg(float4 a) { return {{-a.v[0], -a.v[1], -a.v[2], -a.v[3]}}; }
+inline float4 yzx(float4 a) { return {{a.v[1], a.v[2], a.v[0], a.v[3]}}; }
+inline float sum3(float4 a) { return a.v[0] + a.v[1] + a.v[2]; }
+inline float min3(float4 a) { return std::min(std::min(a.v[0], a.v[1]), a.v[2]); }
+inline float max3(float4 a) { return std::max(std::max(a.v[0], a.v[1]), a.v[2]); }
+#endif
+}
 
-    Vector3f operator * (const Vector3f &v) const { return Vector3f(x * v.x, y * v.y, z * v.z); }
-    Vector3f operator - (const Vector3f &v) const { return Vector3f(x - v.x, y - v.y, z - v.z); }
-    Vector3f operator + (const Vector3f &v) const { return Vector3f(x + v.x, y + v.y, z + v.z); }
-    Vector3f operator - () const { return Vector3f(-x, -y, -z); }
-    Vector3f& operator += (const Vector3f &v) { x += v.x, y += v.y, z += v.z; return *this; }
+// Three floats in a 16 byte aligned 4-lane register, every operation works
+// on all lanes at once. The 4th lane is padding, its value is never read.
+class alignas(16) Vector3f {
+public:
+    union {
+        struct { float x, y, z; };
+        simd::float4 m;
+    };
+    Vector3f() : m(simd::splat(0)) {}
+    Vector3f(float xx) : m(simd::set(xx, xx, xx)) {}
+    Vector3f(float xx, float yy, float zz) : m(simd::set(xx, yy, zz)) {}
+    explicit Vector3f(simd::float4 mm) : m(mm) {}
+    Vector3f operator * (const float &r) const { return Vector3f(simd::mul(m, simd::splat(r))); }
+    Vector3f operator / (const float &r) const { return Vector3f(simd::div(m, simd::splat(r))); }
+
+    float norm() const {return std::sqrt(simd::sum3(simd::mul(m, m)));}
+    Vector3f normalized() const { return *this / norm(); }
+
+    Vector3f operator * (const Vector3f &v) const { return Vector3f(simd::mul(m, v.m)); }
+    Vector3f operator - (const Vector3f &v) const { return Vector3f(simd::sub(m, v.m)); }
+    Vector3f operator + (const Vector3f &v) const { return Vector3f(simd::add(m, v.m)); }
+    Vector3f operator - () const { return Vector3f(simd::neg(m)); }
+    Vector3f& operator += (const Vector3f &v) { m = simd::add(m, v.m); return *this; }
+    Vector3f& operator -= (const Vector3f &v) { m = simd::sub(m, v.m); return *this; }
+    Vector3f& operator *= (const Vector3f &v) { m = simd::mul(m, v.m); return *this; }
     friend Vector3f operator * (const float &r, const Vector3f &v)
-    { return Vector3f(v.x * r, v.y * r, v.z * r); }
+    { return v * r; }
     friend std::ostream & operator << (std::ostream &os, const Vector3f &v)
     { return os << v.x << ", " << v.y << ", " << v.z; }
-    double       operator[](int index) const;
-    double&      operator[](int index);
+    float        operator[](int index) const { return (&x)[index]; }
+    float&       operator[](int index) { return (&x)[index]; }
 
 
     static Vector3f Min(const Vector3f &p1, const Vector3f &p2) {
-        return Vector3f(std::min(p1.x, p2.x), std::min(p1.y, p2.y),
-                       std::min(p1.z, p2.z));
+        return Vector3f(simd::min(p1.m, p2.m));
     }
 
     static Vector3f Max(const Vector3f &p1, const Vector3f &p2) {
-        return Vector3f(std::max(p1.x, p2.x), std::max(p1.y, p2.y),
-                       std::max(p1.z, p2.z));
+        return Vector3f(simd::max(p1.m, p2.m));
     }
 };
-inline double Vector3f::operator[](int index) const {
-    return (&x)[index];
-}
 
 
 class Vector2f
@@ -63,27 +124,61 @@ public:
 inline Vector3f lerp(const Vector3f &a, const Vector3f& b, const float &t)
 { return a * (1 - t) + b * t; }
 
+inline float dotProduct(const Vector3f &a, const Vector3f &b)
+{ return simd::sum3(simd::mul(a.m, b.m)); }
+
 inline Vector3f normalize(const Vector3f &v)
 {
-    float mag2 = v.x * v.x + v.y * v.y + v.z * v.z;
-    if (mag2 > 0) {
-        float invMag = 1 / sqrtf(mag2);
-        return Vector3f(v.x * invMag, v.y * invMag, v.z * invMag);
-    }
+    float mag2 = dotProduct(v, v);
+    if (mag2 > 0)
+        return v * (1 / sqrtf(mag2));
 
     return v;
 }
 
-inline float dotProduct(const Vector3f &a, const Vector3f &b)
-{ return a.x * b.x + a.y * b.y + a.z * b.z; }
-
 inline Vector3f crossProduct(const Vector3f &a, const Vector3f &b)
 {
-    return Vector3f(
-            a.y * b.z - a.z * b.y,
-            a.z * b.x - a.x * b.z,
-            a.x * b.y - a.y * b.x
-    );
+    // a * b.yzx - a.yzx * b holds the result rotated by one lane
+    simd::float4 c = simd::sub(simd::mul(a.m, simd::yzx(b.m)), simd::mul(simd::yzx(a.m), b.m));
+    return Vector3f(simd::yzx(c));
+}
+
+// 1 / v per component, by a true division: rcpps with a Newton step turns
+// the infinities of zero components into NaN, the slab test relies on them
+inline Vector3f rcp(const Vector3f &v)
+{ return Vector3f(simd::div(simd::splat(1), v.m)); }
+
+inline float minComponent(const Vector3f &v) { return simd::min3(v.m); }
+inline float maxComponent(const Vector3f &v) { return simd::max3(v.m); }
+
+// Pack a unit vector into 2x16 bits with the octahedral mapping, used to
+// store per-vertex normals in 4 bytes instead of 12.
+inline uint32_t encodeOctNormal(const Vector3f &n)
+{
+    float invL1 = 1.f / (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+    float u = n.x * invL1, v = n.y * invL1;
+    if (n.z < 0) {
+        float fu = (1 - std::fabs(v)) * (u >= 0 ? 1.f : -1.f);
+        float fv = (1 - std::fabs(u)) * (v >= 0 ? 1.f : -1.f);
+        u = fu, v = fv;
+    }
+    auto quantize = [](float f) {
+        return (uint32_t)std::lround((std::clamp(f, -1.f, 1.f) * 0.5f + 0.5f) * 65535.f);
+    };
+    return quantize(u) | (quantize(v) << 16);
+}
+
+inline Vector3f decodeOctNormal(uint32_t packed)
+{
+    float u = (packed & 0xffff) / 65535.f * 2 - 1;
+    float v = (packed >> 16) / 65535.f * 2 - 1;
+    Vector3f n(u, v, 1 - std::fabs(u) - std::fabs(v));
+    if (n.z < 0) {
+        float t = -n.z;
+        n.x += n.x >= 0 ? -t : t;
+        n.y += n.y >= 0 ? -t : t;
+    }
+    return normalize(n);
 }
 
 
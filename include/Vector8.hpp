@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cmath>
+#include "Vector.hpp"
+
+// One float per ray of a batch of 8. The operations are plain loops over
+// the lanes, which the compiler turns into AVX instructions where the build
+// enables them and into pairs of SSE instructions otherwise.
+struct alignas(32) Float8
+{
+    float v[8];
+
+    Float8() = default;
+    Float8(float f) { for (int i = 0; i < 8; ++i) v[i] = f; }
+
+    float operator[](int i) const { return v[i]; }
+    float& operator[](int i) { return v[i]; }
+
+    template <typename Op>
+    static Float8 lanes(const Float8& a, const Float8& b, Op op)
+    {
+        Float8 r;
+        for (int i = 0; i < 8; ++i)
+            r.v[i] = op(a.v[i], b.v[i]);
+        return r;
+    }
+
+    Float8 operator+(const Float8& b) const { return lanes(*this, b, [](float p, float q) { return p + q; }); }
+    Float8 operator-(const Float8& b) const { return lanes(*this, b, [](float p, float q) { return p - q; }); }
+    Float8 operator*(const Float8& b) const { return lanes(*this, b, [](float p, float q) { return p * q; }); }
+    Float8 operator/(const Float8& b) const { return lanes(*this, b, [](float p, float q) { return p / q; }); }
+};
+
+inline Float8 sqrt(const Float8& a)
+{
+    Float8 r;
+    for (int i = 0; i < 8; ++i)
+        r.v[i] = std::sqrt(a.v[i]);
+    return r;
+}
+
+inline Float8 min(const Float8& a, const Float8& b)
+{
+    return Float8::lanes(a, b, [](float p, float q) { return std::min(p, q); });
+}
+
+inline Float8 max(const Float8& a, const Float8& b)
+{
+    return Float8::lanes(a, b, [](float p, float q) { return std::max(p, q); });
+}
+
+// 8 vectors as separate x, y and z arrays, so that each operation works on
+// the same component of all of them. The formulas match those of Vector3f
+// term by term, lane i of a result equals the Vector3f computation.
+struct Vector3f8
+{
+    Float8 x, y, z;
+
+    Vector3f8() = default;
+    Vector3f8(const Float8& xx, const Float8& yy, const Float8& zz) : x(xx), y(yy), z(zz) {}
+    // the same vector in every lane
+    Vector3f8(const Vector3f& v) : x(v.x), y(v.y), z(v.z) {}
+
+    Vector3f get(int i) const { return Vector3f(x[i], y[i], z[i]); }
+    void set(int i, const Vector3f& v) { x[i] = v.x, y[i] = v.y, z[i] = v.z; }
+
+    Vector3f8 operator+(const Vector3f8& b) const { return {x + b.x, y + b.y, z + b.z}; }
+    Vector3f8 operator-(const Vector3f8& b) const { return {x - b.x, y - b.y, z - b.z}; }
+    Vector3f8 operator*(const Vector3f8& b) const { return {x * b.x, y * b.y, z * b.z}; }
+    Vector3f8 operator*(const Float8& f) const { return {x * f, y * f, z * f}; }
+    Vector3f8 operator/(const Float8& f) const { return {x / f, y / f, z / f}; }
+};
+
+inline Float8 dotProduct(const Vector3f8& a, const Vector3f8& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Vector3f8 crossProduct(const Vector3f8& a, const Vector3f8& b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+inline Float8 norm(const Vector3f8& a)
+{
+    return sqrt(dotProduct(a, a));
+}
@@ -2,6 +2,9 @@
 #include <iostream>
 #include <cmath>
 #include <random>
+#include <cstdint>
+#include <cstring>
+#include <string>
 
 #undef M_PI
 #define M_PI 3.141592653589793f
@@ -29,13 +32,140 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
     return true;
 }
 
-inline float get_random_float()
+// IEEE 754 binary16 conversion, round to nearest even
+inline uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t mag = x & 0x7fffffff;
+    if (mag >= 0x7f800000) // inf or nan
+        return sign | 0x7c00 | (mag > 0x7f800000 ? 0x200 : 0);
+    if (mag >= 0x477ff000) // rounds past the largest half
+        return sign | 0x7c00;
+    if (mag < 0x38800000) // subnormal half or zero
+    {
+        if (mag < 0x33000000)
+            return sign;
+        uint32_t e = mag >> 23;
+        uint32_t m = (mag & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - e;
+        uint32_t h = m >> shift;
+        uint32_t rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1)))
+            ++h;
+        return sign | h;
+    }
+    uint32_t h = ((mag - 0x38000000) >> 13);
+    uint32_t rem = mag & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        ++h;
+    return sign | h;
+}
+
+inline float halfToFloat(uint16_t h)
+{
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t e = (h >> 10) & 0x1f, m = h & 0x3ff;
+    uint32_t x;
+    if (e == 0)
+    {
+        if (m == 0)
+            x = sign;
+        else
+        {
+            // renormalize the subnormal
+            e = 113;
+            while (!(m & 0x400))
+                m <<= 1, --e;
+            x = sign | (e << 23) | ((m & 0x3ff) << 13);
+        }
+    }
+    else if (e == 31)
+        x = sign | 0x7f800000 | (m << 13);
+    else
+        x = sign | ((e + 112) << 23) | (m << 13);
+    float f;
+    std::memcpy(&f, &x, 4);
+    return f;
+}
+
+// PCG32 (O'Neill), small enough to be reseeded for every camera sample
+class Pcg32
 {
-    thread_local std::random_device dev;
-    thread_local std::mt19937 rng(dev());
-    thread_local std::uniform_real_distribution<float> dist(0.f, 1.f); // distribution in range [0, 1]
+public:
+    void seed(uint64_t initState, uint64_t initSeq = 0xda3e39cb94b95bdbULL)
+    {
+        state = 0;
+        inc = (initSeq << 1) | 1;
+        next();
+        state += initState;
+        next();
+    }
+
+    uint32_t next()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
 
-    return dist(rng);
+private:
+    uint64_t state = 0, inc = 1;
+};
+
+inline uint64_t mixBits(uint64_t v)
+{
+    // splitmix64 finalizer
+    v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+    return v ^ (v >> 31);
+}
+
+// order dependent hash of a sequence of values, tells the settings a
+// checkpoint was made with apart from others
+struct Hasher
+{
+    uint64_t value = 0;
+
+    void add(uint64_t v) { value = mixBits(value ^ v) + 0x9e3779b97f4a7c15ULL; }
+    void addFloat(float f)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        add(bits);
+    }
+    void addString(const std::string& s)
+    {
+        add(s.size());
+        for (unsigned char c : s)
+            add(c);
+    }
+};
+
+inline Pcg32& random_engine()
+{
+    thread_local Pcg32 rng = [] {
+        std::random_device dev;
+        Pcg32 r;
+        r.seed((uint64_t(dev()) << 32) | dev());
+        return r;
+    }();
+    return rng;
+}
+
+// makes the random sequence of this thread a function of (seed, pixel, sample)
+inline void seed_random(uint64_t seed, uint32_t pixel, uint32_t sample)
+{
+    random_engine().seed(mixBits(seed ^ mixBits((uint64_t(pixel) << 32) | sample)));
+}
+
+inline float get_random_float()
+{
+    // 24 random bits, in range [0, 1)
+    return (random_engine().next() >> 8) * (1.f / 16777216.f);
 }
 
 inline void UpdateProgress(float progress)
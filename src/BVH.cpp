@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cassert>
 #include "BVH.hpp"
+#include "Stats.hpp"
 
 BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
                    SplitMethod splitMethod)
@@ -12,7 +13,7 @@ BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
     if (primitives.empty())
         return;
 
-    root = recursiveBuild(primitives);
+    Build();
 
     time(&stop);
     double diff = difftime(stop, start);
@@ -25,9 +26,86 @@ BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
         hrs, mins, secs);
 }
 
+Bounds3 BVHAccel::WorldBound() const
+{
+    if (!root)
+        return Bounds3();
+    return root->boundsClose ? Union(root->bounds, *root->boundsClose) : root->bounds;
+}
+
+namespace
+{
+// the SAH cost of the subtree, times the surface area of the root
+float sahSum(const BVHBuildNode* node)
+{
+    float area = node->bounds.SurfaceArea();
+    if (node->object)
+        return area;
+    return area + sahSum(node->left) + sahSum(node->right);
+}
+}
+
+void BVHAccel::setBoundsClose(BVHBuildNode* node)
+{
+    if (!motion)
+        return;
+    if (!node->boundsClose)
+        node->boundsClose = nodes.create<Bounds3>();
+    *node->boundsClose = node->object ? node->object->getMotionBounds()
+                                      : Union(*node->left->boundsClose, *node->right->boundsClose);
+}
+
+void BVHAccel::refitNode(BVHBuildNode* node)
+{
+    if (node->object)
+    {
+        node->bounds = node->object->getBounds();
+        node->area = node->object->getArea();
+    }
+    else
+    {
+        refitNode(node->left);
+        refitNode(node->right);
+        node->bounds = Union(node->left->bounds, node->right->bounds);
+        node->area = node->left->area + node->right->area;
+    }
+    setBoundsClose(node);
+}
+
+void BVHAccel::Build()
+{
+    motion = std::any_of(primitives.begin(), primitives.end(), [](Object* p) { return p->isMoving(); });
+    nodes.reset();
+    root = primitives.empty() ? nullptr : recursiveBuild(primitives);
+    buildCost = SAHCost();
+}
+
+bool BVHAccel::Refit(float maxCostIncrease)
+{
+    if (!root)
+        return false;
+    // the nodes lack or have needless boundsClose when that changed
+    bool moving = std::any_of(primitives.begin(), primitives.end(), [](Object* p) { return p->isMoving(); });
+    if (moving == motion)
+    {
+        refitNode(root);
+        if (SAHCost() <= buildCost * maxCostIncrease)
+            return false;
+    }
+
+    Build();
+    return true;
+}
+
+float BVHAccel::SAHCost() const
+{
+    float rootArea = root ? root->bounds.SurfaceArea() : 0;
+    return rootArea > 0 ? sahSum(root) / rootArea : 0;
+}
+
 BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
 {
-    BVHBuildNode* node = new BVHBuildNode();
+    BVHBuildNode* node = nodes.create<BVHBuildNode>();
 
     // Compute bounds of all primitives in BVH node
     Bounds3 bounds;
@@ -40,6 +118,7 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
         node->left = nullptr;
         node->right = nullptr;
         node->area = objects[0]->getArea();
+        setBoundsClose(node);
         return node;
     }
     else if (objects.size() == 2) {
@@ -48,6 +127,7 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
         node->area = node->left->area + node->right->area;
+        setBoundsClose(node);
         return node;
     }
     else {
@@ -56,6 +136,7 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
             centroidBounds =
                 Union(centroidBounds, objects[i]->getBounds().Centroid());
         int dim = centroidBounds.maxExtent();
+        node->splitAxis = dim;
         switch (dim) {
         case 0:
             std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
@@ -91,6 +172,7 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
         node->area = node->left->area + node->right->area;
+        setBoundsClose(node);
     }
 
     return node;
@@ -98,29 +180,42 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
 
 Intersection BVHAccel::Intersect(const Ray& ray) const
 {
-    Intersection isect;
+    HitRecord hit;
+    if (!Intersect(ray, hit))
+        return Intersection();
+    return hit.obj->getSurface(ray, hit);
+}
+
+bool BVHAccel::Intersect(const Ray& ray, HitRecord& hit) const
+{
     if (!root)
-        return isect;
-    isect = BVHAccel::getIntersection(root, ray);
-    return isect;
+        return false;
+    return motion ? getIntersection<true>(root, ray, hit) : getIntersection<false>(root, ray, hit);
 }
 
-Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
+template <bool Motion>
+bool BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray, HitRecord& hit) const
 {
     // Traverse the BVH to find intersection
-    std::array<int, 3> dirIsNeg = {ray.direction.x < 0, ray.direction.y < 0, ray.direction.z < 0};
-    if (!node->bounds.IntersectP(ray, ray.direction_inv, dirIsNeg)) 
-        return Intersection();
+    STAT_INC(bvhNodesVisited);
+    // nothing beyond the closest hit so far can matter
+    float tMax = std::min(ray.tMax, hit.t);
+    bool enters = Motion ? lerp(node->bounds, *node->boundsClose, ray.time).IntersectP(ray, tMax)
+                         : node->bounds.IntersectP(ray, tMax);
+    if (!enters)
+        return false;
 
     if (node->object)
-    {
-        return node->object->getIntersection(ray);
-    }
-
-    Intersection left = getIntersection(node->left, ray);
-    Intersection right = getIntersection(node->right, ray);
-    
-    return left.distance < right.distance ? left : right;
+        return node->object->intersect(ray, hit);
+
+    // the nearer child first, the farther one is then often culled
+    BVHBuildNode* first = node->left;
+    BVHBuildNode* second = node->right;
+    if (ray.dirIsNeg[node->splitAxis])
+        std::swap(first, second);
+    bool hitFirst = getIntersection<Motion>(first, ray, hit);
+    bool hitSecond = getIntersection<Motion>(second, ray, hit);
+    return hitFirst || hitSecond;
 }
 
 
@@ -135,7 +230,7 @@ void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &
 }
 
 void BVHAccel::Sample(Intersection &pos, float &pdf){
-    float p = std::sqrt(get_random_float()) * root->area;
+    float p = get_random_float() * root->area;
     getSample(root, p, pos, pdf);
     pdf /= root->area;
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cmath>
+#include "Denoiser.hpp"
+
+namespace
+{
+const float MinAlbedo = 0.01f;
+
+float luminance(const Vector3f& c)
+{
+    return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+Vector3f maxAlbedo(const Vector3f& a)
+{
+    return Vector3f(std::max(a.x, MinAlbedo), std::max(a.y, MinAlbedo), std::max(a.z, MinAlbedo));
+}
+}
+
+void denoise(int width, int height, const std::vector<Vector3f>& color,
+             const std::vector<Vector3f>& albedo, const std::vector<Vector3f>& normal,
+             std::vector<float> variance, const DenoiseOptions& options,
+             std::vector<Vector3f>& result)
+{
+    const int n = width * height;
+    std::vector<Vector3f> irradiance(n), next(n);
+    std::vector<float> nextVariance(n);
+
+    // filter lighting only, the albedo is multiplied back in at the end
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+    {
+        Vector3f a = maxAlbedo(albedo[i]);
+        irradiance[i] = Vector3f(color[i].x / a.x, color[i].y / a.y, color[i].z / a.z);
+        float la = std::max(luminance(a), MinAlbedo);
+        variance[i] /= la * la;
+    }
+
+    static const float kernel[3] = {3.f / 8, 1.f / 4, 1.f / 16};
+    for (int iteration = 0, step = 1; iteration < options.iterations; ++iteration, step *= 2)
+    {
+#pragma omp parallel for schedule(dynamic, 8)
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                int p = y * width + x;
+
+                // 3x3 blurred variance is more stable for the edge stopping
+                float var = 0, varWeight = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        int qx = x + dx, qy = y + dy;
+                        if (qx < 0 || qy < 0 || qx >= width || qy >= height)
+                            continue;
+                        float k = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+                        var += k * variance[qy * width + qx];
+                        varWeight += k;
+                    }
+                float lumDenom = options.sigmaLuminance * std::sqrt(std::max(var / varWeight, 0.f)) + 1e-4f;
+
+                float lp = luminance(irradiance[p]);
+                Vector3f sum = irradiance[p] * (kernel[0] * kernel[0]);
+                float weightSum = kernel[0] * kernel[0];
+                float varSum = variance[p] * weightSum * weightSum;
+                for (int dy = -2; dy <= 2; ++dy)
+                    for (int dx = -2; dx <= 2; ++dx)
+                    {
+                        int qx = x + dx * step, qy = y + dy * step;
+                        if ((dx == 0 && dy == 0) || qx < 0 || qy < 0 || qx >= width || qy >= height)
+                            continue;
+                        int q = qy * width + qx;
+
+                        float wn = std::pow(std::max(0.f, dotProduct(normal[p], normal[q])), options.sigmaNormal);
+                        if (wn <= 0)
+                            continue;
+                        Vector3f da = albedo[p] - albedo[q];
+                        float wa = std::exp(-dotProduct(da, da) / (options.sigmaAlbedo * options.sigmaAlbedo));
+                        float wl = std::exp(-std::fabs(lp - luminance(irradiance[q])) / lumDenom);
+                        float w = kernel[std::abs(dx)] * kernel[std::abs(dy)] * wn * wa * wl;
+
+                        sum += irradiance[q] * w;
+                        weightSum += w;
+                        varSum += variance[q] * w * w;
+                    }
+                next[p] = sum / weightSum;
+                nextVariance[p] = varSum / (weightSum * weightSum);
+            }
+        std::swap(irradiance, next);
+        std::swap(variance, nextVariance);
+    }
+
+    result.resize(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+        result[i] = irradiance[i] * maxAlbedo(albedo[i]);
+}
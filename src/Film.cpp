@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "Film.hpp"
+
+namespace
+{
+const char FilmMagic[8] = {'R', 'T', 'F', 'I', 'L', 'M', '2', '\n'};
+
+float rgbLuminance(const Vector3f& c)
+{
+    return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+template <typename T>
+void writeArray(std::ostream& out, const std::vector<T>& v)
+{
+    out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+}
+
+template <typename T>
+void readArray(std::istream& in, std::vector<T>& v)
+{
+    in.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+}
+
+// component by component, the file must not depend on the layout of Vector3f
+void writeArray(std::ostream& out, const std::vector<Vector3f>& v)
+{
+    std::vector<float> flat(v.size() * 3);
+    for (size_t i = 0; i < v.size(); ++i)
+        flat[i * 3] = v[i].x, flat[i * 3 + 1] = v[i].y, flat[i * 3 + 2] = v[i].z;
+    writeArray(out, flat);
+}
+
+void readArray(std::istream& in, std::vector<Vector3f>& v)
+{
+    std::vector<float> flat(v.size() * 3);
+    readArray(in, flat);
+    for (size_t i = 0; i < v.size(); ++i)
+        v[i] = Vector3f(flat[i * 3], flat[i * 3 + 1], flat[i * 3 + 2]);
+}
+
+template <typename T>
+void writeValue(std::ostream& out, const T& v)
+{
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+void readValue(std::istream& in, T& v)
+{
+    in.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+}
+
+Film::Film(int width, int height, uint32_t flags) : w(width), h(height), flags(flags)
+{
+    allocate();
+}
+
+void Film::allocate()
+{
+    size_t n = size_t(w) * h;
+    sampleCount.assign(n, 0);
+    color.assign(n, Vector3f(0));
+    albedo.assign(flags & AOV_ALBEDO ? n : 0, Vector3f(0));
+    normal.assign(flags & AOV_NORMAL ? n : 0, Vector3f(0));
+    direct.assign(flags & AOV_DIRECT ? n : 0, Vector3f(0));
+    indirect.assign(flags & AOV_INDIRECT ? n : 0, Vector3f(0));
+    depth.assign(flags & AOV_DEPTH ? n : 0, 0.f);
+    materialId.assign(flags & AOV_MATERIAL_ID ? n : 0, -1.f);
+    luminance.assign(flags & AOV_VARIANCE ? n : 0, 0.f);
+    luminance2.assign(flags & AOV_VARIANCE ? n : 0, 0.f);
+    hitCount.assign(flags & (AOV_DEPTH | AOV_MATERIAL_ID) ? n : 0, 0);
+}
+
+void Film::addSample(int index, const Vector3f& L, const AOVSample* aov)
+{
+    ++sampleCount[index];
+    color[index] += L;
+    if (flags & AOV_VARIANCE)
+    {
+        float l = rgbLuminance(L);
+        luminance[index] += l;
+        luminance2[index] += l * l;
+    }
+    if (!aov)
+        return;
+    if (flags & AOV_ALBEDO) albedo[index] += aov->albedo;
+    if (flags & AOV_NORMAL) normal[index] += aov->normal;
+    if (flags & AOV_DIRECT) direct[index] += aov->direct;
+    if (flags & AOV_INDIRECT) indirect[index] += aov->indirect;
+    // depth averages the samples that hit something, the material ID is the
+    // one of the first sample that did
+    if (aov->hit && !hitCount.empty())
+    {
+        if (flags & AOV_DEPTH) depth[index] += aov->depth;
+        if ((flags & AOV_MATERIAL_ID) && hitCount[index] == 0)
+            materialId[index] = (float)aov->materialId;
+        ++hitCount[index];
+    }
+}
+
+bool Film::merge(const Film& other)
+{
+    if (other.w != w || other.h != h || other.flags != flags)
+        return false;
+    auto add = [](auto& a, const auto& b) {
+        for (size_t i = 0; i < a.size(); ++i)
+            a[i] += b[i];
+    };
+    // keep the first material ID found, in the order the films are merged
+    for (size_t i = 0; i < materialId.size(); ++i)
+        if (hitCount[i] == 0)
+            materialId[i] = other.materialId[i];
+    add(sampleCount, other.sampleCount);
+    add(color, other.color);
+    add(albedo, other.albedo);
+    add(normal, other.normal);
+    add(direct, other.direct);
+    add(indirect, other.indirect);
+    add(depth, other.depth);
+    add(luminance, other.luminance);
+    add(luminance2, other.luminance2);
+    add(hitCount, other.hitCount);
+    return true;
+}
+
+std::vector<Vector3f> Film::mean(const std::vector<Vector3f>& sums) const
+{
+    std::vector<Vector3f> result(sums.size());
+    for (size_t i = 0; i < sums.size(); ++i)
+        result[i] = sampleCount[i] ? sums[i] / sampleCount[i] : Vector3f(0);
+    return result;
+}
+
+std::vector<float> Film::variance() const
+{
+    std::vector<float> result(luminance.size());
+    for (size_t i = 0; i < luminance.size(); ++i)
+    {
+        if (!sampleCount[i])
+            continue;
+        float inv = 1.f / sampleCount[i];
+        float m = luminance[i] * inv;
+        result[i] = std::max(0.f, luminance2[i] * inv - m * m) * inv;
+    }
+    return result;
+}
+
+void Film::appendLayers(std::vector<ImageLayer>& layers, uint32_t mask) const
+{
+    uint32_t f = flags & mask;
+    if (f & AOV_ALBEDO) layers.push_back(ImageLayer::fromRGB("albedo", mean(albedo)));
+    if (f & AOV_NORMAL) layers.push_back(ImageLayer::fromRGB("normal", mean(normal)));
+    if (f & AOV_DEPTH)
+    {
+        std::vector<float> d(depth.size());
+        for (size_t i = 0; i < d.size(); ++i)
+            d[i] = hitCount[i] ? depth[i] / hitCount[i] : 0.f;
+        layers.push_back(ImageLayer::fromGray("depth", d));
+    }
+    if (f & AOV_MATERIAL_ID) layers.push_back(ImageLayer::fromGray("materialid", materialId));
+    if (f & AOV_DIRECT) layers.push_back(ImageLayer::fromRGB("direct", mean(direct)));
+    if (f & AOV_INDIRECT) layers.push_back(ImageLayer::fromRGB("indirect", mean(indirect)));
+    if (f & AOV_VARIANCE) layers.push_back(ImageLayer::fromGray("variance", variance()));
+}
+
+bool Film::save(const std::string& filename, const RenderProgress& progress) const
+{
+    std::string tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out)
+            return false;
+        out.write(FilmMagic, sizeof(FilmMagic));
+        writeValue(out, int32_t(w));
+        writeValue(out, int32_t(h));
+        writeValue(out, flags);
+        writeValue(out, progress.seed);
+        writeValue(out, int32_t(progress.spp));
+        writeValue(out, int32_t(progress.samplesDone));
+        writeValue(out, int32_t(progress.part));
+        writeValue(out, int32_t(progress.parts));
+        writeValue(out, int32_t(progress.partition));
+        writeValue(out, progress.sceneHash);
+        writeArray(out, sampleCount);
+        writeArray(out, color);
+        writeArray(out, albedo);
+        writeArray(out, normal);
+        writeArray(out, direct);
+        writeArray(out, indirect);
+        writeArray(out, depth);
+        writeArray(out, materialId);
+        writeArray(out, luminance);
+        writeArray(out, luminance2);
+        writeArray(out, hitCount);
+        if (!out.flush())
+            return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, filename, ec);
+    return !ec;
+}
+
+bool Film::load(const std::string& filename, RenderProgress& progress)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char magic[sizeof(FilmMagic)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, FilmMagic, sizeof(magic)) != 0)
+        return false;
+    int32_t width, height, spp, done, part, parts, partition;
+    readValue(in, width);
+    readValue(in, height);
+    readValue(in, flags);
+    readValue(in, progress.seed);
+    readValue(in, spp);
+    readValue(in, done);
+    readValue(in, part);
+    readValue(in, parts);
+    readValue(in, partition);
+    readValue(in, progress.sceneHash);
+    if (!in || width <= 0 || height <= 0)
+        return false;
+    w = width, h = height;
+    progress.spp = spp;
+    progress.samplesDone = done;
+    progress.part = part;
+    progress.parts = parts;
+    progress.partition = partition;
+    allocate();
+    readArray(in, sampleCount);
+    readArray(in, color);
+    readArray(in, albedo);
+    readArray(in, normal);
+    readArray(in, direct);
+    readArray(in, indirect);
+    readArray(in, depth);
+    readArray(in, materialId);
+    readArray(in, luminance);
+    readArray(in, luminance2);
+    readArray(in, hitCount);
+    return bool(in);
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "ImageIO.hpp"
+#include "global.hpp"
+
+ImageLayer ImageLayer::fromRGB(const std::string& name, const std::vector<Vector3f>& pixels)
+{
+    ImageLayer layer;
+    layer.name = name;
+    layer.channels = 3;
+    layer.data.resize(pixels.size() * 3);
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+        layer.data[i * 3] = pixels[i].x;
+        layer.data[i * 3 + 1] = pixels[i].y;
+        layer.data[i * 3 + 2] = pixels[i].z;
+    }
+    return layer;
+}
+
+ImageLayer ImageLayer::fromGray(const std::string& name, const std::vector<float>& pixels)
+{
+    return ImageLayer{name, 1, pixels};
+}
+
+bool writePPM(const std::string& filename, int width, int height, const ImageLayer& layer)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+        return false;
+    (void)fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    for (int i = 0; i < width * height; ++i)
+    {
+        unsigned char color[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            float v = layer.data[i * layer.channels + std::min(c, layer.channels - 1)];
+            color[c] = (unsigned char)(255.99 * std::sqrt(clamp(0, 1, v)));
+        }
+        fwrite(color, 1, 3, fp);
+    }
+    return fclose(fp) == 0;
+}
+
+bool writePFM(const std::string& filename, int width, int height, const ImageLayer& layer)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+        return false;
+    // negative scale marks little endian data, rows are stored bottom to top
+    (void)fprintf(fp, "%s\n%d %d\n-1.0\n", layer.channels == 1 ? "Pf" : "PF", width, height);
+    size_t rowFloats = size_t(width) * layer.channels;
+    for (int y = height - 1; y >= 0; --y)
+        fwrite(&layer.data[y * rowFloats], sizeof(float), rowFloats, fp);
+    return fclose(fp) == 0;
+}
+
+bool readPFM(const std::string& filename, int& width, int& height, ImageLayer& layer)
+{
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (!fp)
+        return false;
+    char magic[3] = {};
+    float scale = 0;
+    bool ok = fscanf(fp, "%2s %d %d %f", magic, &width, &height, &scale) == 4 && fgetc(fp) != EOF &&
+              (!strcmp(magic, "PF") || !strcmp(magic, "Pf")) && width > 0 && height > 0 && scale != 0;
+    if (ok)
+    {
+        layer.name.clear();
+        layer.channels = magic[1] == 'F' ? 3 : 1;
+        size_t rowFloats = size_t(width) * layer.channels;
+        layer.data.resize(rowFloats * height);
+        for (int y = height - 1; ok && y >= 0; --y)
+            ok = fread(&layer.data[y * rowFloats], sizeof(float), rowFloats, fp) == rowFloats;
+        // a positive scale marks big endian data
+        if (ok && scale > 0)
+            for (float& f : layer.data)
+            {
+                auto* b = reinterpret_cast<unsigned char*>(&f);
+                std::swap(b[0], b[3]);
+                std::swap(b[1], b[2]);
+            }
+    }
+    fclose(fp);
+    return ok;
+}
+
+namespace
+{
+struct ByteWriter
+{
+    std::vector<unsigned char> bytes;
+
+    void raw(const void* p, size_t n)
+    {
+        auto* b = static_cast<const unsigned char*>(p);
+        bytes.insert(bytes.end(), b, b + n);
+    }
+    void u8(uint8_t v) { raw(&v, 1); }
+    void i32(int32_t v) { raw(&v, 4); } // EXR is little endian, as are our targets
+    void u64(uint64_t v) { raw(&v, 8); }
+    void f32(float v) { raw(&v, 4); }
+    void str(const std::string& s) { raw(s.c_str(), s.size() + 1); }
+
+    void attribute(const std::string& name, const std::string& type, int32_t size)
+    {
+        str(name);
+        str(type);
+        i32(size);
+    }
+};
+
+struct ExrChannel
+{
+    std::string name;
+    const ImageLayer* layer;
+    int component;
+};
+
+// byte reordering and delta predictor shared by the RLE and ZIP codecs
+void exrPredict(const std::vector<unsigned char>& in, std::vector<unsigned char>& out)
+{
+    out.resize(in.size());
+    size_t half = (in.size() + 1) / 2;
+    for (size_t i = 0; i < in.size(); ++i)
+        out[(i & 1) ? half + i / 2 : i / 2] = in[i];
+    int prev = out.empty() ? 0 : out[0];
+    for (size_t i = 1; i < out.size(); ++i)
+    {
+        int d = int(out[i]) - prev + (128 + 256);
+        prev = out[i];
+        out[i] = (unsigned char)d;
+    }
+}
+
+// OpenEXR RLE: a positive count n is followed by one byte repeated n + 1
+// times, a negative count -n by n literal bytes
+void exrRLE(const std::vector<unsigned char>& in, std::vector<unsigned char>& out)
+{
+    const int MaxRun = 127, MinRun = 3;
+    out.clear();
+    size_t n = in.size(), runStart = 0, runEnd = 1;
+    while (runStart < n)
+    {
+        while (runEnd < n && in[runStart] == in[runEnd] && runEnd - runStart - 1 < MaxRun)
+            ++runEnd;
+        if (runEnd - runStart >= MinRun)
+        {
+            out.push_back((unsigned char)(runEnd - runStart - 1));
+            out.push_back(in[runStart]);
+            runStart = runEnd;
+        }
+        else
+        {
+            while (runEnd < n &&
+                   (runEnd + 1 >= n || in[runEnd] != in[runEnd + 1] ||
+                    runEnd + 2 >= n || in[runEnd + 1] != in[runEnd + 2]) &&
+                   runEnd - runStart < MaxRun)
+                ++runEnd;
+            out.push_back((unsigned char)(int8_t)-(int)(runEnd - runStart));
+            out.insert(out.end(), in.begin() + runStart, in.begin() + runEnd);
+            runStart = runEnd;
+        }
+        ++runEnd;
+    }
+}
+}
+
+bool writeEXR(const std::string& filename, int width, int height,
+              const std::vector<ImageLayer>& layers, const ExrOptions& options)
+{
+    std::vector<ExrChannel> channels;
+    for (auto& layer : layers)
+    {
+        std::string prefix = layer.name.empty() ? "" : layer.name + ".";
+        if (layer.channels == 1)
+            channels.push_back({layer.name.empty() ? "Y" : layer.name, &layer, 0});
+        else
+            for (int c = 0; c < 3; ++c)
+                channels.push_back({prefix + "RGB"[c], &layer, c});
+    }
+    // readers expect the channel list in sorted order
+    std::sort(channels.begin(), channels.end(),
+              [](const ExrChannel& a, const ExrChannel& b) { return a.name < b.name; });
+
+    ByteWriter out;
+    out.i32(20000630);
+    bool longNames = std::any_of(channels.begin(), channels.end(),
+                                 [](const ExrChannel& c) { return c.name.size() > 31; });
+    out.i32(2 | (longNames ? 0x400 : 0));
+
+    int32_t chlistSize = 1;
+    for (auto& c : channels)
+        chlistSize += (int32_t)c.name.size() + 1 + 16;
+    out.attribute("channels", "chlist", chlistSize);
+    int32_t pixelType = options.halfFloat ? 1 : 2;
+    for (auto& c : channels)
+    {
+        out.str(c.name);
+        out.i32(pixelType);
+        out.u8(0); // pLinear
+        out.u8(0), out.u8(0), out.u8(0);
+        out.i32(1), out.i32(1); // x/y sampling
+    }
+    out.u8(0);
+
+    out.attribute("compression", "compression", 1);
+    out.u8(options.rle ? 1 : 0);
+    for (const char* window : {"dataWindow", "displayWindow"})
+    {
+        out.attribute(window, "box2i", 16);
+        out.i32(0), out.i32(0), out.i32(width - 1), out.i32(height - 1);
+    }
+    out.attribute("lineOrder", "lineOrder", 1);
+    out.u8(0); // increasing y
+    out.attribute("pixelAspectRatio", "float", 4);
+    out.f32(1);
+    out.attribute("screenWindowCenter", "v2f", 8);
+    out.f32(0), out.f32(0);
+    out.attribute("screenWindowWidth", "float", 4);
+    out.f32(1);
+    out.u8(0); // end of header
+
+    // one scanline per chunk for both NONE and RLE
+    size_t tableOffset = out.bytes.size();
+    out.bytes.resize(tableOffset + 8 * size_t(height));
+
+    std::vector<unsigned char> line, predicted, packed;
+    for (int y = 0; y < height; ++y)
+    {
+        line.clear();
+        for (auto& c : channels)
+            for (int x = 0; x < width; ++x)
+            {
+                float v = c.layer->data[(size_t(y) * width + x) * c.layer->channels + c.component];
+                if (options.halfFloat)
+                {
+                    uint16_t h = floatToHalf(v);
+                    line.insert(line.end(), (unsigned char*)&h, (unsigned char*)&h + 2);
+                }
+                else
+                    line.insert(line.end(), (unsigned char*)&v, (unsigned char*)&v + 4);
+            }
+
+        const std::vector<unsigned char>* data = &line;
+        if (options.rle)
+        {
+            exrPredict(line, predicted);
+            exrRLE(predicted, packed);
+            // incompressible lines are stored as is
+            if (packed.size() < line.size())
+                data = &packed;
+        }
+
+        uint64_t offset = out.bytes.size();
+        std::memcpy(&out.bytes[tableOffset + 8 * size_t(y)], &offset, 8);
+        out.i32(y);
+        out.i32((int32_t)data->size());
+        out.raw(data->data(), data->size());
+    }
+
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+        return false;
+    fwrite(out.bytes.data(), 1, out.bytes.size(), fp);
+    return fclose(fp) == 0;
+}
+
+bool writeImage(const std::string& filename, int width, int height,
+                const std::vector<ImageLayer>& layers, const ExrOptions& options)
+{
+    std::filesystem::path path(filename);
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".exr")
+        return writeEXR(filename, width, height, layers, options);
+
+    bool ok = true;
+    for (auto& layer : layers)
+    {
+        std::filesystem::path file = path;
+        if (!layer.name.empty())
+            file.replace_filename(path.stem().string() + "." + layer.name + path.extension().string());
+        if (ext == ".pfm")
+            ok &= writePFM(file.string(), width, height, layer);
+        else
+            ok &= writePPM(file.string(), width, height, layer);
+    }
+    return ok;
+}
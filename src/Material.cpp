@@ -2,6 +2,51 @@
 // Created by fhp on 25-3-19.
 //
 
-#include "Material.hpp"
+#include <unordered_map>
+#include "MaterialTable.hpp"
+#include "Object.hpp"
 
+namespace
+{
+// the image behind a texture, nullptr for a constant one
+const Texture* textureMap(const std::shared_ptr<Texture>& texture, Vector3f& constant)
+{
+    if (auto* c = dynamic_cast<const ConstantTexture*>(texture.get()))
+    {
+        constant = c->color;
+        return nullptr;
+    }
+    return texture.get();
+}
+}
 
+MaterialRecord MaterialTable::compile(const Material& m)
+{
+    MaterialRecord r;
+    r.type = m.m_type;
+    r.emissive = m.m_emission.norm() > 1e-6;
+    r.roughness = m.roughness;
+    r.ior = m.ior;
+    r.pDiffuse = m.pDiffuse;
+    r.pSpecular = m.pSpecular;
+    r.emission = m.m_emission;
+    r.kd = m.Kd;
+    r.ks = m.Ks;
+    r.diffuseMap = textureMap(m.diffuseTexture, r.kd);
+    r.specularMap = textureMap(m.specularTexture, r.ks);
+    return r;
+}
+
+void MaterialTable::build(const std::vector<Object*>& objects)
+{
+    records.clear();
+    std::unordered_map<Material*, uint32_t> ids;
+    for (Object* object : objects)
+    {
+        Material* m = object->getMaterial();
+        if (!m || ids.count(m))
+            continue;
+        m->id = ids[m] = records.size();
+        records.push_back(compile(*m));
+    }
+}
@@ -0,0 +1,30 @@
+#include <algorithm>
+#include "MemoryArena.hpp"
+
+void* MemoryArena::alloc(size_t bytes, size_t align)
+{
+    size_t start = (offset + align - 1) & ~(align - 1);
+    if (blocks.empty() || start + bytes > blocks.back().size)
+    {
+        // objects larger than a block get a block of their own
+        size_t size = std::max(bytes, blockSize);
+        auto* data = static_cast<std::byte*>(::operator new(size, std::align_val_t(BlockAlignment)));
+        blocks.push_back({data, size});
+        reserved += size;
+        start = 0;
+    }
+    offset = start + bytes;
+    return blocks.back().data + start;
+}
+
+void MemoryArena::reset()
+{
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+        it->destroy(it->object);
+    destructors.clear();
+    for (auto& block : blocks)
+        ::operator delete(block.data, std::align_val_t(BlockAlignment));
+    blocks.clear();
+    offset = 0;
+    reserved = 0;
+}
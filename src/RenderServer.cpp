@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include "RenderServer.hpp"
+
+namespace fs = std::filesystem;
+
+int RenderServer::runPending()
+{
+    std::vector<fs::path> jobs;
+    for (auto& entry : fs::directory_iterator(jobDirectory))
+        if (entry.is_regular_file() && entry.path().extension() == ".job")
+            jobs.push_back(entry.path());
+    std::sort(jobs.begin(), jobs.end());
+    for (auto& job : jobs)
+        runJob(job);
+    return (int)jobs.size();
+}
+
+void RenderServer::run(int pollMilliseconds)
+{
+    std::cout << "Waiting for jobs in " << jobDirectory << "\n";
+    for (;;)
+        if (!runPending())
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollMilliseconds));
+}
+
+RenderServer::ResidentScene& RenderServer::getScene(const std::string& file)
+{
+    auto modified = fs::last_write_time(file);
+    if (auto it = scenes.find(file); it != scenes.end())
+    {
+        if (it->second.modified == modified)
+            return it->second;
+        // free the old scene and the textures only it used before loading
+        // the new one
+        scenes.erase(it);
+        TextureRegistry::instance().release();
+    }
+
+    ResidentScene resident;
+    resident.desc = loadSceneFile(file);
+    resident.scene = std::make_unique<Scene>(resident.desc.width, resident.desc.height);
+    buildScene(resident.desc, *resident.scene);
+    resident.scene->buildBVH();
+    resident.modified = modified;
+    return scenes[file] = std::move(resident);
+}
+
+void RenderServer::runJob(const fs::path& job)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string error;
+    try
+    {
+        ResidentScene& resident = getScene(readJobScene(job.string()));
+        SceneDescription desc = resident.desc;
+        applyJobFile(job.string(), desc);
+        applySceneSettings(desc, *resident.scene);
+
+        std::chrono::duration<double> setup = std::chrono::steady_clock::now() - start;
+        std::cout << "Job " << job.filename().string() << ": setup took " << setup.count() << " s\n";
+        Renderer renderer(desc.render);
+        bool written = desc.frames > 0
+                           ? renderer.RenderAnimation(*resident.scene, desc.cameraPath, 0, desc.frames - 1)
+                           : renderer.Render(*resident.scene);
+        if (!written)
+            error = "cannot write " + desc.render.output;
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+        // a scene that failed to load leaves the textures it loaded behind
+        TextureRegistry::instance().release();
+    }
+
+    fs::path finished = job;
+    finished.replace_extension(error.empty() ? ".done" : ".failed");
+    std::error_code ec;
+    fs::rename(job, finished, ec);
+    if (ec)
+    {
+        // never pick the same job up again
+        std::cerr << "Cannot rename " << job << ": " << ec.message() << ", removing it\n";
+        fs::remove(job, ec);
+        return;
+    }
+    if (!error.empty())
+    {
+        std::cerr << "Job " << job.filename().string() << " failed: " << error << "\n";
+        std::ofstream(finished, std::ios::app) << "\n# error: " << error << "\n";
+    }
+}
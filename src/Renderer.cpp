@@ -2,113 +2,324 @@
 // Created by goksu on 2/25/20.
 //
 
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <future>
 #include "Scene.hpp"
 #include "Renderer.hpp"
+#include "Stats.hpp"
 #include <omp.h>
 
 
-inline float deg2rad(const float &deg) { return deg * M_PI / 180.0; }
-
 const float EPSILON = 0.00016;
 const float epsilon = 0.00001;
 
 int prog = 0;
+int progTotal = 1;
 omp_lock_t lock;
 
-void Renderer::ompCastRay(const Scene &scene, std::vector<Vector3f> &framebuffer, int start, int end)
+void Renderer::ompCastRay(const Scene &scene, Film &film, uint64_t seed, int start, int end,
+                          int firstSample, int count)
 {
-    // 计算视野缩放系数和长宽比
-    // float scale = tan(deg2rad(20.1143 * 0.5));  // 使用 scene.fovy，单位为度
-    float scale = tan(deg2rad(35.9834 * 0.5));  // 使用 scene.fovy，单位为度
-    float imageAspectRatio = scene.width / (float) scene.height;
-
-    // 使用场景中的摄像机参数
-    Vector3f eye_pos = Vector3f(4.443147659301758, 16.934431076049805, 49.91023254394531);      // scene.camera.lookfrom
-    Vector3f forward = normalize(Vector3f(-2.5734899044036865, 9.991769790649414, -10.588199615478516) - eye_pos);
-    Vector3f right = normalize(crossProduct(forward, Vector3f(0, 1, 0)));
-    Vector3f cameraUp = crossProduct(right, forward);
-
-    int widthPixel, heightPixel;
-    widthPixel = heightPixel = sqrt(spp);
-    float step = 1.f / widthPixel;
-
-    // 对每一行像素进行处理
-    for (int j = start; j < end; j++)
-    {
-        for (int i = 0; i < scene.width; i++)
+    const Camera &camera = scene.camera;
+    const bool aovs = film.aovFlags() != 0;
+
+    // the integrator variant is picked once, the loops below are compiled for each
+    dispatchIntegrator(options.integrator, aovs, [&](auto policy) {
+        using Policy = decltype(policy);
+        std::vector<CameraSample> samples;
+        std::vector<Pcg32> sequences;
+        std::vector<Ray> rays;
+        // 对每一行像素进行处理
+        for (int j = start; j < end; j++)
         {
-            int index = j * scene.width + i;
-            // 对每个像素进行多重采样（抗锯齿）
-            for (int k = 0; k < spp; k++)
+            for (int i = 0; i < scene.width; i++)
             {
-                // 在单个像素内部做随机偏移（这里均匀分布在小网格中）
-                float jitterX = step * (k % widthPixel) + step / 2;
-                float jitterY = step * (k / heightPixel) + step / 2;
-                // 将像素坐标转换为 NDC 坐标 [0,1]
-                float ndcX = (i + jitterX) / (float) scene.width;
-                float ndcY = (j + jitterY) / (float) scene.height;
-                // 将 NDC 映射到屏幕空间 [-1,1]，注意水平要乘上长宽比和 scale
-                float pixelScreenX = (2 * ndcX - 1) * imageAspectRatio * scale;
-                float pixelScreenY = (1 - 2 * ndcY) * scale;
-                // 计算射线方向：在摄像机坐标系下，x 轴沿 right，y 轴沿 cameraUp，z 轴指向 forward
-                Vector3f dir = normalize(pixelScreenX * right + pixelScreenY * cameraUp + forward);
-                framebuffer[index] += scene.castRay(Ray(eye_pos, dir), 0) / spp;
+                if (!ownsPixel(i, j, scene.width))
+                    continue;
+                int index = j * scene.width + i;
+                // 对每个像素进行多重采样（抗锯齿）：先取全部相机样本，再成批生成光线
+                samples.clear();
+                sequences.clear();
+                for (int k = firstSample; k < firstSample + count; k++)
+                {
+                    // every sample has its own random sequence, so passes and
+                    // resumed renders don't depend on the thread that took them
+                    seed_random(seed, index, k);
+
+                    // 在单个像素内部做分层抖动，位置只取决于像素和 k，与 spp 无关
+                    CameraSample& sample = samples.emplace_back();
+                    Vector2f offset = pixelSample(seed, index, k);
+                    sample.x = i + offset.x;
+                    sample.y = j + offset.y;
+                    if (camera.type == THIN_LENS)
+                    {
+                        sample.lensU = get_random_float();
+                        sample.lensV = get_random_float();
+                    }
+                    if (scene.motionBlur)
+                        sample.time = get_random_float();
+                    sequences.push_back(random_engine());
+                }
+                camera.generateRays(samples, rays);
+
+                for (size_t n = 0; n < rays.size(); n++)
+                {
+                    // the path continues the random sequence of its camera sample
+                    random_engine() = sequences[n];
+                    AOVSample aov;
+                    STAT_INC(primaryRays);
+                    Vector3f L = scene.castRay<Policy>(rays[n], 0, &aov);
+                    film.addSample(index, L, Policy::aovs ? &aov : nullptr);
+                }
             }
+            omp_set_lock(&lock);
+            UpdateProgress(++prog / (float) progTotal);
+            omp_unset_lock(&lock);
         }
-        omp_set_lock(&lock);
-        UpdateProgress(++prog / (float) scene.height);
-        omp_unset_lock(&lock);
-    }
+    });
 }
 
 // The main render function. This where we iterate over all pixels in the image,
 // generate primary rays and cast these rays into the scene. The content of the
 // framebuffer is saved to a file.
-void Renderer::Render(const Scene &scene)
+bool Renderer::Render(const Scene &scene)
+{
+    Film film;
+    RenderProgress progress;
+    RenderFilm(scene, film, progress);
+    return WriteOutput(film, progress);
+}
+
+void Renderer::RenderFilm(const Scene &scene, Film &film, RenderProgress &progress)
 {
     omp_init_lock(&lock);
 
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    // the denoiser is guided by buffers that may not be written out
+    bool denoising = options.denoise.iterations > 0;
+    uint32_t guides = denoising ? AOV_ALBEDO | AOV_NORMAL | AOV_VARIANCE : 0;
+    film = Film(scene.width, scene.height, options.aovs | guides);
+
+    // parts of a distributed render must agree on the seed
+    const bool partial = options.parts > 1;
+    progress = RenderProgress();
+    progress.spp = options.spp;
+    progress.seed = options.seed;
+    if (!progress.seed)
+        progress.seed = partial ? 0x5eed : (uint64_t(std::random_device()()) << 32) | std::random_device()();
+
+    int sampleBegin = 0, sampleEnd = options.spp;
+    if (partial && options.partition == RenderOptions::SAMPLES)
+    {
+        sampleBegin = int(int64_t(options.spp) * options.part / options.parts);
+        sampleEnd = int(int64_t(options.spp) * (options.part + 1) / options.parts);
+    }
+    progress.samplesDone = sampleBegin;
+    progress.part = options.part;
+    progress.parts = options.parts;
+    progress.partition = partial ? options.partition : RenderOptions::SAMPLES;
+    progress.sceneHash = checkpointHash(scene);
+
+    bool checkpointing = !options.checkpoint.empty();
+    if (checkpointing && options.resume && std::filesystem::exists(options.checkpoint))
+    {
+        Film saved;
+        RenderProgress savedProgress;
+        if (!saved.load(options.checkpoint, savedProgress))
+            std::cerr << "Cannot read checkpoint " << options.checkpoint << ", starting over\n";
+        else if (saved.width() != film.width() || saved.height() != film.height() ||
+                 saved.aovFlags() != film.aovFlags() || savedProgress.part != progress.part ||
+                 savedProgress.parts != progress.parts || savedProgress.partition != progress.partition)
+            std::cerr << "Checkpoint " << options.checkpoint << " doesn't match the render settings, starting over\n";
+        else if (savedProgress.sceneHash != progress.sceneHash)
+            std::cerr << "Checkpoint " << options.checkpoint << " was made with another scene, camera or integrator, starting over\n";
+        else
+        {
+            // a higher spp than before simply continues taking samples, a
+            // sample's position depends on the seed, its pixel and its index
+            // alone
+            film = std::move(saved);
+            progress.seed = savedProgress.seed;
+            progress.samplesDone = savedProgress.samplesDone;
+            std::cout << "Resuming after " << progress.samplesDone << " samples per pixel\n";
+        }
+    }
+
+    // without checkpoints all samples of a pixel are taken at once
+    const int samplesPerPass = checkpointing ? std::max(1, (sampleEnd - sampleBegin + 31) / 32)
+                                             : std::max(1, sampleEnd - sampleBegin);
+    const int remaining = std::max(0, sampleEnd - progress.samplesDone);
+    const int passes = (remaining + samplesPerPass - 1) / samplesPerPass;
 
     const int threadNum = 20;
     const int threadStep = scene.height / threadNum;
     const int remainder = scene.height % threadNum;
 
-    // change the spp value to change sample ammount
-    spp = 32;
-    std::cout << "SPP: " << spp << "\n";
+    std::cout << "SPP: " << options.spp << "\n";
+    prog = 0;
+    progTotal = std::max(1, passes * scene.height);
 
-#pragma omp parallel for
-    for (int i = 0; i < threadNum; i++)
+    resetStats();
+    auto renderStart = std::chrono::steady_clock::now();
+    auto lastCheckpoint = renderStart;
+    for (int pass = 0; pass < passes; ++pass)
     {
-        // Calculate the start and end row for each thread
-        int startRow = i * threadStep;
-        int endRow = (i + 1) * threadStep;
+        int first = progress.samplesDone;
+        int count = std::min(samplesPerPass, sampleEnd - first);
 
-        // For the last thread, add the remainder to ensure all rows are processed
-        if (i == threadNum - 1)
+#pragma omp parallel for
+        for (int i = 0; i < threadNum; i++)
         {
-            endRow += remainder;
+            // Calculate the start and end row for each thread
+            int startRow = i * threadStep;
+            int endRow = (i + 1) * threadStep;
+
+            // For the last thread, add the remainder to ensure all rows are processed
+            if (i == threadNum - 1)
+            {
+                endRow += remainder;
+            }
+
+            ompCastRay(scene, film, progress.seed, startRow, endRow, first, count);
         }
+        progress.samplesDone += count;
 
-        ompCastRay(scene, framebuffer, startRow, endRow);
+        auto now = std::chrono::steady_clock::now();
+        bool last = pass == passes - 1;
+        if (checkpointing && (last || now - lastCheckpoint >= std::chrono::seconds(options.checkpointInterval)))
+        {
+            if (!film.save(options.checkpoint, progress))
+                std::cerr << "\nCannot write checkpoint " << options.checkpoint << "\n";
+            lastCheckpoint = now;
+        }
     }
 
     UpdateProgress(1.f);
+    std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - renderStart;
+    std::cout << "\n";
+    printStats(std::cout, gatherStats(), renderTime.count());
 
-    // save framebuffer to file
-    FILE *fp = fopen("myTest.ppm", "wb");
-    (void) fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i)
+    omp_destroy_lock(&lock);
+}
+
+bool Renderer::WriteOutput(const Film &film, const RenderProgress &progress) const
+{
+    bool written = options.parts > 1 ? film.save(options.output, progress) : writeFilm(film, options);
+    if (!written)
+        std::cerr << "Cannot write " << options.output << "\n";
+    return written;
+}
+
+namespace
+{
+// name.ext becomes name.0042.ext
+std::string frameFileName(const std::string &name, int frame)
+{
+    if (name.empty())
+        return name;
+    std::filesystem::path path(name);
+    char number[16];
+    snprintf(number, sizeof(number), ".%04d", frame);
+    std::filesystem::path ext = path.extension();
+    return path.replace_extension().string() + number + ext.string();
+}
+}
+
+bool Renderer::RenderAnimation(Scene &scene, const CameraPath &path, int firstFrame, int lastFrame)
+{
+    const Camera base = scene.camera;
+    bool written = true;
+    std::future<bool> writing;
+    for (int frame = firstFrame; frame <= lastFrame; ++frame)
     {
-        static unsigned char color[3];
-        color[0] = (unsigned char) (255.99 * std::sqrt(clamp(0, 1, framebuffer[i].x)));
-        color[1] = (unsigned char) (255.99 * std::sqrt(clamp(0, 1, framebuffer[i].y)));
-        color[2] = (unsigned char) (255.99 * std::sqrt(clamp(0, 1, framebuffer[i].z)));
-        fwrite(color, 1, 3, fp);
+        std::cout << "Frame " << frame << "\n";
+        scene.camera = path.at(base, frame);
+
+        RenderOptions frameOptions = options;
+        frameOptions.output = frameFileName(options.output, frame);
+        frameOptions.checkpoint = frameFileName(options.checkpoint, frame);
+        Renderer renderer(frameOptions);
+        Film film;
+        RenderProgress progress;
+        renderer.RenderFilm(scene, film, progress);
+
+        // frame n is written while frame n + 1 renders
+        if (writing.valid())
+            written &= writing.get();
+        writing = std::async(std::launch::async, [renderer, film = std::move(film), progress] {
+            return renderer.WriteOutput(film, progress);
+        });
     }
-    fclose(fp);
+    if (writing.valid())
+        written &= writing.get();
+    scene.camera = base;
+    return written;
+}
 
-    omp_destroy_lock(&lock);
+bool Renderer::writeFilm(const Film &film, const RenderOptions &options)
+{
+    // save framebuffer to file, unclamped unless the format is 8-bit
+    std::vector<Vector3f> framebuffer = film.mean(film.color);
+    std::vector<ImageLayer> layers;
+    const uint32_t guides = AOV_ALBEDO | AOV_NORMAL | AOV_VARIANCE;
+    bool denoising = options.denoise.iterations > 0;
+    if (denoising && (film.aovFlags() & guides) != guides)
+    {
+        std::cerr << "The film has no albedo, normal and variance to guide the denoiser, skipping it\n";
+        denoising = false;
+    }
+    if (denoising)
+    {
+        std::vector<Vector3f> denoised;
+        denoise(film.width(), film.height(), framebuffer, film.mean(film.albedo), film.mean(film.normal),
+                film.variance(), options.denoise, denoised);
+        layers.push_back(ImageLayer::fromRGB("", denoised));
+        layers.push_back(ImageLayer::fromRGB("noisy", framebuffer));
+    }
+    else
+        layers.push_back(ImageLayer::fromRGB("", framebuffer));
+    film.appendLayers(layers, options.aovs);
+    return writeImage(options.output, film.width(), film.height(), layers, options.exr);
+}
+
+Vector2f Renderer::pixelSample(uint64_t seed, uint32_t pixel, int k)
+{
+    // the bits of k % 16 are, from the lowest, the high bit of the stratum's
+    // x, the high bit of y, the low bit of x and the low bit of y
+    int i = k % 16;
+    int x = (i & 1) << 1 | (i >> 2 & 1);
+    int y = (i >> 1 & 1) << 1 | (i >> 3 & 1);
+    // flipping bits keeps those properties; every 16 samples flip anew, with
+    // a hash salted to differ from the seeds of seed_random
+    uint64_t flip = mixBits(mixBits(seed + 0x9e3779b97f4a7c15ULL) ^ ((uint64_t(pixel) << 32) | uint32_t(k / 16)));
+    x ^= flip & 3;
+    y ^= flip >> 2 & 3;
+    float jx = get_random_float(), jy = get_random_float();
+    return Vector2f((x + jx) * 0.25f, (y + jy) * 0.25f);
+}
+
+// tiles are dealt out round robin, so every part gets some of each region
+bool Renderer::ownsPixel(int x, int y, int width) const
+{
+    if (options.parts <= 1 || options.partition != RenderOptions::TILES)
+        return true;
+    int tilesX = (width + PartTileSize - 1) / PartTileSize;
+    int tile = (y / PartTileSize) * tilesX + x / PartTileSize;
+    return tile % options.parts == options.part;
+}
+
+uint64_t Renderer::checkpointHash(const Scene &scene) const
+{
+    Hasher h;
+    h.add(options.sceneHash);
+    h.add(uint64_t(options.integrator));
+    const Camera &camera = scene.camera;
+    h.add(camera.type);
+    for (const Vector3f &v : {camera.eye, camera.lookAt, camera.up})
+        h.addFloat(v.x), h.addFloat(v.y), h.addFloat(v.z);
+    for (float f : {camera.fov, camera.aperture, camera.focusDistance, camera.orthoHeight,
+                    scene.RussianRoulette, scene.diffuseConeSpread})
+        h.addFloat(f);
+    return h.value;
 }
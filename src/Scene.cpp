@@ -1,9 +1,24 @@
 #include "Scene.hpp"
+#include "Stats.hpp"
+
+namespace
+{
+// where a ray leaving p in direction w starts: off the surface with normal N,
+// on the side of w. The offset grows with the coordinates, it has to exceed
+// their rounding error or the ray can hit the surface it leaves.
+Vector3f offsetRayOrigin(const Vector3f &p, const Vector3f &N, const Vector3f &w)
+{
+    float offset = epsilon * std::max(1.f, p.norm());
+    return dotProduct(w, N) < 0 ? p - N * offset : p + N * offset;
+}
+}
 
 void Scene::buildBVH()
 {
     printf(" - Generating BVH...\n\n");
-    this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    this->bvh = arena.create<BVHAccel>(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    materials.build(objects);
+    motionBlur = bvh->motion;
 }
 
 Intersection Scene::intersect(const Ray &ray) const
@@ -11,6 +26,11 @@ Intersection Scene::intersect(const Ray &ray) const
     return this->bvh->Intersect(ray);
 }
 
+bool Scene::intersect(const Ray &ray, HitRecord &hit) const
+{
+    return this->bvh->Intersect(ray, hit);
+}
+
 void Scene::sampleLight(Intersection &pos, float &pdf) const
 {
     float emit_area_sum = 0;
@@ -21,7 +41,8 @@ void Scene::sampleLight(Intersection &pos, float &pdf) const
             emit_area_sum += objects[k]->getArea();
         }
     }
-    float p = get_random_float() * emit_area_sum;
+    float total = emit_area_sum;
+    float p = get_random_float() * total;
     emit_area_sum = 0;
     for (uint32_t k = 0; k < objects.size(); ++k)
     {
@@ -30,7 +51,9 @@ void Scene::sampleLight(Intersection &pos, float &pdf) const
             emit_area_sum += objects[k]->getArea();
             if (p <= emit_area_sum)
             {
+                // the object is picked with a probability of its share of the area
                 objects[k]->Sample(pos, pdf);
+                pdf *= objects[k]->getArea() / total;
                 break;
             }
         }
@@ -60,90 +83,131 @@ bool Scene::trace(
 }
 
 // Implementation of Path Tracing
-Vector3f Scene::castRay(const Ray &ray, int depth) const
+template <class Policy>
+Vector3f Scene::castRay(const Ray &ray, int depth, AOVSample *aov, bool emission) const
 {
+    using Next = typename Policy::Continuation;
+
     // get the intersection
     Intersection intersection = Scene::intersect(ray);
 
     if (!intersection.happened)
     {
+        STAT_PATH_LENGTH(depth);
         return {};
     }
+    bool continued = false; // whether the path goes on in a recursive call
+    // whether the path may take another bounce at all
+    constexpr bool bounces = Policy::maxDepth != 1;
+    bool lastBounce = Policy::maxDepth > 0 && depth + 1 >= Policy::maxDepth;
 
     Vector3f L_dir(0);
     Vector3f L_indir(0);
 
+    const MaterialRecord& material = materials[intersection.m->id];
     Vector3f hitPoint = intersection.coords;
     Vector3f N = normalize(intersection.normal);
     Vector3f wo = normalize(-ray.direction);
 
+    // width of the ray cone at the hit, projected into texture space
+    float coneWidth = ray.coneWidth + ray.coneSpread * intersection.distance;
+    float uvWidth = coneWidth * intersection.uvScale / std::max(std::fabs(dotProduct(wo, N)), 0.2f);
+
+    if constexpr (Policy::aovs)
+    {
+        aov->hit = true;
+        aov->albedo = materialAlbedo(material, intersection.tcoords, uvWidth);
+        aov->normal = N;
+        aov->depth = intersection.distance;
+        aov->materialId = intersection.m->id;
+    }
+
     // hit light
-    if (intersection.happened && intersection.m->hasEmission())
+    if (material.emissive && emission)
     {
         L_dir += intersection.emit;
     }
 
-    switch (intersection.m->getType())
+    switch (material.type)
     {
         case DIELECTRIC:
         {
-            if (get_random_float() < RussianRoulette)
+            if (bounces && !lastBounce && get_random_float() < RussianRoulette)
             {
-                Vector3f wi = normalize(intersection.m->sample(wo, N));
-                Vector3f reflectionRayOrig = (dotProduct(wi, N) < 0) ? hitPoint - N * epsilon : hitPoint + N * epsilon;
+                Vector3f wi = normalize(sampleMaterial(material, wo, N));
+                Vector3f reflectionRayOrig = offsetRayOrigin(hitPoint, N, wi);
                 Ray reflectionRay(reflectionRayOrig, wi);
-                Intersection reflectionInter = Scene::intersect(reflectionRay);
-                if (reflectionInter.happened)
+                reflectionRay.coneWidth = coneWidth;
+                reflectionRay.time = ray.time;
+                reflectionRay.coneSpread = ray.coneSpread;
+                if (float pdf = materialPdf(material, wo, wi, N); pdf > EPSILON)
                 {
-                    if (float pdf = intersection.m->pdf(wo, wi, N); pdf > EPSILON)
-                    {
-                        L_indir = castRay(reflectionRay, depth + 1) * intersection.m->eval(wi, wo, N, intersection.tcoords) *
-                                  std::max(0.f, dotProduct(wi, N)) / (pdf * RussianRoulette);
-                    }
+                    STAT_INC(indirectRays);
+                    continued = true;
+                    L_indir = castRay<Next>(reflectionRay, depth + 1) * evalMaterial(material, wi, wo, N, intersection.tcoords, uvWidth) *
+                              std::max(0.f, dotProduct(wi, N)) / (pdf * RussianRoulette);
                 }
             }
             break;
         }
         default:
         {
-            Intersection lightInter;
-            float pdf_light;
-            sampleLight(lightInter, pdf_light);
-            Vector3f x = lightInter.coords;
-            Vector3f NN = normalize(lightInter.normal);
-            Vector3f lightDirection = normalize(x - hitPoint);
-            float distance = (x - hitPoint).norm();
-            Vector3f lightRayOrigin = (dotProduct(lightDirection, N) < 0)
-                                          ? hitPoint - N * epsilon
-                                          : hitPoint + N * epsilon;
-            Ray shadowRay(lightRayOrigin, lightDirection);
-            Intersection shadowInter = Scene::intersect(shadowRay);
-
-            if (fabs(distance - shadowInter.distance) < EPSILON)
+            if constexpr (Policy::directLighting)
             {
-                L_dir = lightInter.emit * intersection.m->eval(lightDirection, wo, N, intersection.tcoords) *
-                        std::max(dotProduct(lightDirection, N), 0.f) * std::max(dotProduct(-lightDirection, NN), 0.f) /
-                        (distance * distance * pdf_light);
+                Intersection lightInter;
+                float pdf_light;
+                sampleLight(lightInter, pdf_light);
+                Vector3f x = lightInter.coords;
+                Vector3f NN = normalize(lightInter.normal);
+                Vector3f lightRayOrigin = offsetRayOrigin(hitPoint, N, x - hitPoint);
+                Vector3f lightDirection = normalize(x - lightRayOrigin);
+                float distance = (x - lightRayOrigin).norm();
+                Ray shadowRay(lightRayOrigin, lightDirection);
+                // the light is visible if nothing lies in between; the ray
+                // stops short of it by as much as rays start off surfaces, as
+                // a hit on the light itself lands within its rounding error
+                shadowRay.tMax = distance - epsilon * std::max(1.f, x.norm());
+                shadowRay.time = ray.time;
+                STAT_INC(shadowRays);
+                HitRecord shadowHit;
+
+                if (!Scene::intersect(shadowRay, shadowHit))
+                {
+                    L_dir += lightInter.emit * evalMaterial(material, lightDirection, wo, N, intersection.tcoords, uvWidth) *
+                            std::max(dotProduct(lightDirection, N), 0.f) * std::max(dotProduct(-lightDirection, NN), 0.f) /
+                            (distance * distance * pdf_light);
+                }
             }
 
-            if (get_random_float() < RussianRoulette)
+            if (bounces && !lastBounce && get_random_float() < RussianRoulette)
             {
-                Vector3f wi = normalize(intersection.m->sample(wo, N));
-                Vector3f reflectionRayOrig = (dotProduct(wi, N) < 0) ? hitPoint - N * epsilon : hitPoint + N * epsilon;
+                Vector3f wi = normalize(sampleMaterial(material, wo, N));
+                Vector3f reflectionRayOrig = offsetRayOrigin(hitPoint, N, wi);
                 Ray reflectionRay(reflectionRayOrig, wi);
-                Intersection reflectionInter = Scene::intersect(reflectionRay);
-                if (reflectionInter.happened && !reflectionInter.m->hasEmission())
+                reflectionRay.coneWidth = coneWidth;
+                reflectionRay.time = ray.time;
+                reflectionRay.coneSpread = std::max(ray.coneSpread, diffuseConeSpread);
+                if (float pdf = materialPdf(material, wo, wi, N); pdf > EPSILON)
                 {
-                    if (float pdf = intersection.m->pdf(wo, wi, N); pdf > EPSILON)
-                    {
-                        L_indir = castRay(reflectionRay, depth + 1) * intersection.m->eval(wi, wo, N, intersection.tcoords) *
-                                  std::max(0.f, dotProduct(wi, N)) / (pdf * RussianRoulette);
-                    }
+                    // with light sampling, the emission of the next hit was
+                    // already counted above; the light it reflects was not
+                    STAT_INC(indirectRays);
+                    continued = true;
+                    L_indir = castRay<Next>(reflectionRay, depth + 1, nullptr, !Policy::directLighting) *
+                              evalMaterial(material, wi, wo, N, intersection.tcoords, uvWidth) *
+                              std::max(0.f, dotProduct(wi, N)) / (pdf * RussianRoulette);
                 }
             }
             break;
         }
     }
+    if (!continued)
+        STAT_PATH_LENGTH(depth + 1);
+    if constexpr (Policy::aovs)
+    {
+        aov->direct = L_dir;
+        aov->indirect = L_indir;
+    }
     auto hitColor = L_dir + L_indir;
     // hitColor.x = (clamp(0, 1, hitColor.x));
     // hitColor.y = (clamp(0, 1, hitColor.y));
@@ -151,3 +215,11 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
 
     return hitColor;
 }
+
+// the variants dispatchIntegrator selects from
+template Vector3f Scene::castRay<PathPolicy>(const Ray &, int, AOVSample *, bool) const;
+template Vector3f Scene::castRay<BsdfPolicy>(const Ray &, int, AOVSample *, bool) const;
+template Vector3f Scene::castRay<DirectPolicy>(const Ray &, int, AOVSample *, bool) const;
+template Vector3f Scene::castRay<IntegratorPolicy<true, 0, true>>(const Ray &, int, AOVSample *, bool) const;
+template Vector3f Scene::castRay<IntegratorPolicy<false, 0, true>>(const Ray &, int, AOVSample *, bool) const;
+template Vector3f Scene::castRay<IntegratorPolicy<true, 1, true>>(const Ray &, int, AOVSample *, bool) const;
@@ -0,0 +1,563 @@
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "SceneFile.hpp"
+#include "Sphere.hpp"
+#include "TileCache.h"
+#include "Triangle.hpp"
+#include "global.hpp"
+
+namespace
+{
+struct LineReader
+{
+    std::istringstream in;
+    std::string filename;
+    int lineNo;
+
+    [[noreturn]] void fail(const std::string& msg) const
+    {
+        throw std::runtime_error(filename + ":" + std::to_string(lineNo) + ": " + msg);
+    }
+
+    template <typename T>
+    T read(const char* what)
+    {
+        T value;
+        if (!(in >> value))
+            fail(std::string("expected ") + what);
+        return value;
+    }
+
+    Vector3f readVector(const char* what)
+    {
+        float x = read<float>(what), y = read<float>(what), z = read<float>(what);
+        return Vector3f(x, y, z);
+    }
+
+    void expectEnd()
+    {
+        std::string extra;
+        if (in >> extra)
+            fail("unexpected '" + extra + "'");
+    }
+};
+
+MaterialType parseMaterialType(LineReader& line)
+{
+    auto name = line.read<std::string>("material type");
+    if (name == "diffuse")
+        return DIFFUSE;
+    if (name == "microfacet")
+        return MICROFACET;
+    if (name == "dielectric")
+        return DIELECTRIC;
+    line.fail("unknown material type '" + name + "'");
+}
+
+CameraType parseCameraType(LineReader& line)
+{
+    auto name = line.read<std::string>("camera type");
+    if (name == "pinhole")
+        return PINHOLE;
+    if (name == "thinlens")
+        return THIN_LENS;
+    if (name == "orthographic")
+        return ORTHOGRAPHIC;
+    line.fail("unknown camera type '" + name + "'");
+}
+
+IntegratorType parseIntegratorType(LineReader& line)
+{
+    auto name = line.read<std::string>("integrator");
+    IntegratorType type;
+    if (!parseIntegrator(name, type))
+        line.fail("unknown integrator '" + name + "'");
+    return type;
+}
+
+TexelFormat parseTexelFormat(LineReader& line)
+{
+    auto name = line.read<std::string>("texture format");
+    if (name == "unorm8")
+        return TexelFormat::UNorm8;
+    if (name == "half")
+        return TexelFormat::Half16;
+    if (name == "float")
+        return TexelFormat::Float32;
+    if (name == "bc1")
+        return TexelFormat::BC1;
+    line.fail("unknown texture format '" + name + "'");
+}
+
+uint32_t parseAOV(LineReader& line, const std::string& name)
+{
+    if (name == "albedo")
+        return AOV_ALBEDO;
+    if (name == "normal")
+        return AOV_NORMAL;
+    if (name == "depth")
+        return AOV_DEPTH;
+    if (name == "materialid")
+        return AOV_MATERIAL_ID;
+    if (name == "direct")
+        return AOV_DIRECT;
+    if (name == "indirect")
+        return AOV_INDIRECT;
+    if (name == "variance")
+        return AOV_VARIANCE;
+    line.fail("unknown aov '" + name + "'");
+}
+
+void applyMaterial(const MaterialDesc& desc, Material* m)
+{
+    if (desc.type)
+        m->m_type = *desc.type;
+    if (desc.kd)
+    {
+        m->Kd = *desc.kd;
+        m->diffuseTexture = std::make_shared<ConstantTexture>(m->Kd);
+    }
+    if (desc.ks)
+    {
+        m->Ks = *desc.ks;
+        m->specularTexture = std::make_shared<ConstantTexture>(m->Ks);
+    }
+    if (desc.emission)
+        m->setEmission(*desc.emission);
+    if (desc.roughness)
+        m->roughness = *desc.roughness;
+    if (desc.ior)
+        m->ior = *desc.ior;
+    if (desc.kd || desc.ks)
+        m->updateLobeWeights();
+}
+}
+
+const MaterialDesc* SceneDescription::findMaterial(const std::string& name) const
+{
+    for (auto& m : materials)
+        if (m.name == name)
+            return &m;
+    return nullptr;
+}
+
+bool parseIntegrator(const std::string& name, IntegratorType& type)
+{
+    if (name == "path")
+        type = IntegratorType::PATH;
+    else if (name == "bsdf")
+        type = IntegratorType::BSDF;
+    else if (name == "direct")
+        type = IntegratorType::DIRECT;
+    else
+        return false;
+    return true;
+}
+
+namespace
+{
+// the keywords of a scene file that a render job can't change, as the
+// geometry, materials and textures are already loaded by then
+bool isSceneOnly(const std::string& key)
+{
+    for (const char* k : {"obj", "mesh", "sphere", "move", "material", "type", "kd", "ks", "ke", "roughness", "ior",
+                          "textureformat", "texture", "linearize"})
+        if (key == k)
+            return true;
+    return false;
+}
+
+std::ifstream openFile(const std::string& filename, const char* what)
+{
+    std::ifstream file(filename);
+    if (!file)
+        throw std::runtime_error(std::string("cannot open ") + what + " " + filename);
+    return file;
+}
+
+// the shapes, materials and texture settings, which a job can't change; the
+// files they name are hashed by path, not by contents
+uint64_t hashContents(const SceneDescription& desc)
+{
+    Hasher h;
+    auto addVector = [&](const Vector3f& v) {
+        h.addFloat(v.x), h.addFloat(v.y), h.addFloat(v.z);
+    };
+    for (const ShapeDesc& shape : desc.shapes)
+    {
+        h.add(shape.kind);
+        h.addString(shape.path);
+        h.addString(shape.material);
+        addVector(shape.center);
+        h.addFloat(shape.radius);
+        addVector(shape.motion);
+    }
+    for (const MaterialDesc& md : desc.materials)
+    {
+        h.addString(md.name);
+        h.add(md.type ? *md.type + 1 : 0);
+        for (const auto* color : {&md.kd, &md.ks, &md.emission})
+        {
+            h.add(color->has_value());
+            addVector(color->value_or(Vector3f(0)));
+        }
+        for (const auto* value : {&md.roughness, &md.ior})
+        {
+            h.add(value->has_value());
+            h.addFloat(value->value_or(0.f));
+        }
+    }
+    h.add(uint64_t(desc.textureOptions.format));
+    h.add(desc.textureOptions.linearize);
+    std::map<std::string, TexelFormat> formats(desc.textureOptions.formats.begin(),
+                                               desc.textureOptions.formats.end());
+    for (const auto& [path, format] : formats)
+    {
+        h.addString(path);
+        h.add(uint64_t(format));
+    }
+    return h.value;
+}
+
+// reads the lines of a scene file into desc, or those of a job file if
+// jobScene is given, which then receives the scene the job names
+void parseLines(std::istream& file, const std::string& filename, SceneDescription& desc,
+                std::string* jobScene = nullptr)
+{
+    std::filesystem::path base = std::filesystem::path(filename).parent_path();
+    auto resolve = [&](const std::string& p) {
+        std::filesystem::path path(p);
+        return (path.is_relative() ? base / path : path).lexically_normal().string();
+    };
+
+    int material = -1; // index of the open material block
+    std::string text;
+    for (int lineNo = 1; std::getline(file, text); ++lineNo)
+    {
+        if (auto hash = text.find('#'); hash != std::string::npos)
+            text.erase(hash);
+        LineReader line{std::istringstream(text), filename, lineNo};
+        std::string key;
+        if (!(line.in >> key))
+            continue;
+
+        if (jobScene && isSceneOnly(key))
+            line.fail("'" + key + "' belongs in the scene file, not in a job");
+        else if (jobScene && key == "scene")
+            *jobScene = resolve(line.read<std::string>("scene file"));
+        else if (key == "resolution")
+        {
+            desc.width = line.read<int>("width");
+            desc.height = line.read<int>("height");
+            if (desc.width <= 0 || desc.height <= 0)
+                line.fail("resolution must be positive");
+        }
+        else if (key == "spp")
+        {
+            desc.render.spp = line.read<int>("sample count");
+            if (desc.render.spp <= 0)
+                line.fail("spp must be positive");
+        }
+        else if (key == "output")
+        {
+            // a server has no working directory of interest, so job
+            // outputs are relative to the job
+            auto output = line.read<std::string>("file name");
+            desc.render.output = jobScene ? resolve(output) : output;
+        }
+        else if (key == "exrtype")
+        {
+            auto type = line.read<std::string>("half or float");
+            if (type != "half" && type != "float")
+                line.fail("unknown exr channel type '" + type + "'");
+            desc.render.exr.halfFloat = type == "half";
+        }
+        else if (key == "exrcompression")
+        {
+            auto compression = line.read<std::string>("none or rle");
+            if (compression != "none" && compression != "rle")
+                line.fail("unknown exr compression '" + compression + "'");
+            desc.render.exr.rle = compression == "rle";
+        }
+        else if (key == "aov")
+        {
+            desc.render.aovs |= parseAOV(line, line.read<std::string>("aov name"));
+            for (std::string name; line.in >> name;)
+                desc.render.aovs |= parseAOV(line, name);
+        }
+        else if (key == "denoise")
+        {
+            desc.render.denoise.iterations = line.read<int>("number of passes");
+            if (desc.render.denoise.iterations < 0)
+                line.fail("number of passes must not be negative");
+        }
+        else if (key == "checkpoint")
+        {
+            desc.render.checkpoint = resolve(line.read<std::string>("file name"));
+            if (int seconds; line.in >> seconds)
+                desc.render.checkpointInterval = std::max(1, seconds);
+        }
+        else if (key == "seed")
+            desc.render.seed = line.read<uint64_t>("seed");
+        else if (key == "integrator")
+            desc.render.integrator = parseIntegratorType(line);
+        else if (key == "partition")
+        {
+            auto mode = line.read<std::string>("samples or tiles");
+            if (mode != "samples" && mode != "tiles")
+                line.fail("unknown partition '" + mode + "'");
+            desc.render.partition = mode == "tiles" ? RenderOptions::TILES : RenderOptions::SAMPLES;
+        }
+        else if (key == "eye")
+            desc.camera.eye = line.readVector("eye position");
+        else if (key == "lookat")
+            desc.camera.lookAt = line.readVector("look-at point");
+        else if (key == "up")
+            desc.camera.up = line.readVector("up vector");
+        else if (key == "fov")
+            desc.camera.fov = line.read<float>("field of view");
+        else if (key == "camera")
+            desc.camera.type = parseCameraType(line);
+        else if (key == "frames")
+        {
+            desc.frames = line.read<int>("frame count");
+            if (desc.frames < 0)
+                line.fail("frame count must not be negative");
+        }
+        else if (key == "keyframe")
+        {
+            CameraKey cameraKey;
+            cameraKey.frame = line.read<float>("frame");
+            for (std::string field; line.in >> field;)
+            {
+                if (field == "eye")
+                    cameraKey.eye = line.readVector("eye position");
+                else if (field == "lookat")
+                    cameraKey.lookAt = line.readVector("look-at point");
+                else if (field == "up")
+                    cameraKey.up = line.readVector("up vector");
+                else if (field == "fov")
+                    cameraKey.fov = line.read<float>("field of view");
+                else
+                    line.fail("unknown keyframe value '" + field + "'");
+            }
+            desc.cameraPath.add(cameraKey);
+        }
+        else if (key == "camerapath")
+        {
+            auto mode = line.read<std::string>("spline or linear");
+            if (mode != "spline" && mode != "linear")
+                line.fail("unknown camera path interpolation '" + mode + "'");
+            desc.cameraPath.interpolation = mode == "linear" ? CameraPath::LINEAR : CameraPath::SPLINE;
+        }
+        else if (key == "aperture")
+            desc.camera.aperture = line.read<float>("lens radius");
+        else if (key == "focusdistance")
+            desc.camera.focusDistance = line.read<float>("focus distance");
+        else if (key == "orthoheight")
+            desc.camera.orthoHeight = line.read<float>("view height");
+        else if (key == "russianroulette")
+            desc.russianRoulette = line.read<float>("probability");
+        else if (key == "conespread")
+            desc.coneSpread = line.read<float>("spread angle");
+        else if (key == "texturecache")
+            desc.textureCacheMB = line.read<size_t>("cache size in MB");
+        else if (key == "textureformat")
+            desc.textureOptions.format = parseTexelFormat(line);
+        else if (key == "texture")
+        {
+            auto path = resolve(line.read<std::string>("file name"));
+            desc.textureOptions.formats[path] = parseTexelFormat(line);
+        }
+        else if (key == "linearize")
+            desc.textureOptions.linearize = line.read<int>("0 or 1") != 0;
+        else if (key == "obj")
+        {
+            ShapeDesc shape;
+            shape.kind = ShapeDesc::OBJ;
+            shape.path = resolve(line.read<std::string>("file name"));
+            desc.shapes.push_back(shape);
+        }
+        else if (key == "mesh")
+        {
+            ShapeDesc shape;
+            shape.kind = ShapeDesc::MESH;
+            shape.path = resolve(line.read<std::string>("file name"));
+            shape.material = line.read<std::string>("material name");
+            desc.shapes.push_back(shape);
+        }
+        else if (key == "sphere")
+        {
+            ShapeDesc shape;
+            shape.kind = ShapeDesc::SPHERE;
+            shape.center = line.readVector("center");
+            shape.radius = line.read<float>("radius");
+            shape.material = line.read<std::string>("material name");
+            desc.shapes.push_back(shape);
+        }
+        else if (key == "move")
+        {
+            if (desc.shapes.empty())
+                line.fail("'move' before any shape");
+            desc.shapes.back().motion = line.readVector("offset");
+        }
+        else if (key == "material")
+        {
+            auto name = line.read<std::string>("material name");
+            if (desc.findMaterial(name))
+                line.fail("material '" + name + "' defined twice");
+            desc.materials.emplace_back();
+            desc.materials.back().name = name;
+            material = (int)desc.materials.size() - 1;
+        }
+        else if (key == "type" || key == "kd" || key == "ks" || key == "ke" ||
+                 key == "roughness" || key == "ior")
+        {
+            if (material < 0)
+                line.fail("'" + key + "' outside of a material block");
+            MaterialDesc& md = desc.materials[material];
+            if (key == "type")
+                md.type = parseMaterialType(line);
+            else if (key == "kd")
+                md.kd = line.readVector("color");
+            else if (key == "ks")
+                md.ks = line.readVector("color");
+            else if (key == "ke")
+                md.emission = line.readVector("radiance");
+            else if (key == "roughness")
+                md.roughness = line.read<float>("roughness");
+            else
+                md.ior = line.read<float>("index of refraction");
+        }
+        else
+            line.fail("unknown keyword '" + key + "'");
+        line.expectEnd();
+    }
+}
+}
+
+SceneDescription loadSceneFile(const std::string& filename)
+{
+    std::ifstream file = openFile(filename, "scene file");
+    SceneDescription desc;
+    parseLines(file, filename, desc);
+    desc.render.sceneHash = hashContents(desc);
+    return desc;
+}
+
+std::string readJobScene(const std::string& jobFile)
+{
+    std::ifstream file = openFile(jobFile, "job file");
+    SceneDescription ignored;
+    std::string scene;
+    parseLines(file, jobFile, ignored, &scene);
+    if (scene.empty())
+        throw std::runtime_error(jobFile + ": no 'scene' line");
+    return scene;
+}
+
+void applyJobFile(const std::string& jobFile, SceneDescription& desc)
+{
+    std::ifstream file = openFile(jobFile, "job file");
+    std::string scene;
+    parseLines(file, jobFile, desc, &scene);
+}
+
+void applySceneSettings(const SceneDescription& desc, Scene& scene)
+{
+    scene.width = desc.width;
+    scene.height = desc.height;
+    scene.camera = desc.camera;
+    scene.camera.width = desc.width;
+    scene.camera.height = desc.height;
+    scene.camera.update();
+    scene.RussianRoulette = desc.russianRoulette;
+    scene.diffuseConeSpread = desc.coneSpread;
+
+    TileCache::instance().setMemoryLimit(desc.textureCacheMB << 20);
+}
+
+void buildScene(const SceneDescription& desc, Scene& scene)
+{
+    applySceneSettings(desc, scene);
+    TextureRegistry::instance().setLoadOptions(desc.textureOptions);
+
+    // materials defined in the scene file, shared by all shapes using them
+    std::unordered_map<std::string, Material*> materials;
+    auto getMaterial = [&](const std::string& name) {
+        if (auto it = materials.find(name); it != materials.end())
+            return it->second;
+        const MaterialDesc* md = desc.findMaterial(name);
+        if (!md)
+            throw std::runtime_error("undefined material '" + name + "'");
+        Material* m = scene.arena.create<Material>(md->type.value_or(DIFFUSE), Vector3f(0));
+        applyMaterial(*md, m);
+        materials[name] = m;
+        return m;
+    };
+
+    for (auto& shape : desc.shapes)
+    {
+        // lights are sampled at their shutter open position
+        bool moves = shape.motion.x != 0 || shape.motion.y != 0 || shape.motion.z != 0;
+        auto addMesh = [&](MeshTriangle* mesh) {
+            if (moves && mesh->hasEmit())
+                throw std::runtime_error("moving lights are not supported: " + shape.path);
+            if (moves)
+                mesh->setMotion(shape.motion);
+            scene.Add(mesh);
+        };
+
+        switch (shape.kind)
+        {
+        case ShapeDesc::OBJ:
+        {
+            objl::Loader loader;
+            if (!loader.LoadFile(shape.path))
+                throw std::runtime_error("cannot load " + shape.path);
+
+            // decode every diffuse map once, in parallel, before the materials ask for them
+            TextureRegistry::instance().setSearchPath(std::filesystem::path(shape.path).parent_path().string());
+            std::vector<std::string> textureNames;
+            for (auto& mat : loader.LoadedMaterials)
+                if (!mat.map_Kd.empty())
+                    textureNames.push_back(mat.map_Kd);
+            TextureRegistry::instance().preload(textureNames);
+
+            for (auto& mesh : loader.LoadedMeshes)
+            {
+                const MaterialDesc* md = mesh.MeshMaterial.has_value()
+                                             ? desc.findMaterial(mesh.MeshMaterial->name)
+                                             : nullptr;
+                Vector3f emission = md && md->emission ? *md->emission : Vector3f(0.0f);
+                auto* meshTriangle = scene.arena.create<MeshTriangle>(scene.arena, mesh, emission);
+                if (md)
+                    applyMaterial(*md, meshTriangle->m);
+                addMesh(meshTriangle);
+            }
+            break;
+        }
+        case ShapeDesc::MESH:
+            addMesh(scene.arena.create<MeshTriangle>(scene.arena, shape.path, getMaterial(shape.material)));
+            break;
+        case ShapeDesc::SPHERE:
+        {
+            auto* sphere = scene.arena.create<Sphere>(shape.center, shape.radius, getMaterial(shape.material));
+            if (moves && sphere->hasEmit())
+                throw std::runtime_error("moving lights are not supported: sphere with material " + shape.material);
+            sphere->motion = shape.motion;
+            scene.Add(sphere);
+            break;
+        }
+        }
+    }
+
+    TileCache& cache = TileCache::instance();
+    if (cache.encodedBytes() > cache.memoryLimit())
+        std::cerr << "The textures take " << (cache.encodedBytes() >> 20) << " MB, more than the texture cache's "
+                  << (cache.memoryLimit() >> 20) << " MB\n";
+}
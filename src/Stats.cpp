@@ -0,0 +1,138 @@
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#include "Stats.hpp"
+
+namespace
+{
+// leaked like the tile cache, threads may exit after static destruction
+struct StatsRegistry
+{
+    std::mutex mutex;
+    std::vector<RenderStats*> live;
+    RenderStats retired; // counters of threads that exited
+};
+
+StatsRegistry& registry()
+{
+    static StatsRegistry* r = new StatsRegistry();
+    return *r;
+}
+
+const char* const MaterialNames[RenderStats::MaterialTypes] = {"diffuse", "microfacet", "dielectric"};
+}
+
+namespace
+{
+// registered while its thread lives, folded into the retired counters on exit
+struct ThreadStatsSlot
+{
+    RenderStats stats;
+
+    ThreadStatsSlot()
+    {
+        StatsRegistry& r = registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        r.live.push_back(&stats);
+    }
+
+    ~ThreadStatsSlot()
+    {
+        StatsRegistry& r = registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        r.retired.add(stats);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &stats));
+        detail::threadStatsPtr = nullptr;
+    }
+};
+}
+
+RenderStats& detail::registerThreadStats()
+{
+    thread_local ThreadStatsSlot slot;
+    threadStatsPtr = &slot.stats;
+    return slot.stats;
+}
+
+void RenderStats::add(const RenderStats& other)
+{
+    primaryRays += other.primaryRays;
+    shadowRays += other.shadowRays;
+    indirectRays += other.indirectRays;
+    bvhNodesVisited += other.bvhNodesVisited;
+    triangleTests += other.triangleTests;
+    textureLookups += other.textureLookups;
+    tileCacheMisses += other.tileCacheMisses;
+    for (int i = 0; i < MaterialTypes; ++i)
+    {
+        shadingCalls[i] += other.shadingCalls[i];
+        shadingNanos[i] += other.shadingNanos[i];
+    }
+    for (int i = 0; i <= MaxPathLength; ++i)
+        pathLength[i] += other.pathLength[i];
+}
+
+void resetStats()
+{
+    StatsRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.mutex);
+    for (RenderStats* s : r.live)
+        *s = RenderStats();
+    r.retired = RenderStats();
+}
+
+RenderStats gatherStats()
+{
+    StatsRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.mutex);
+    RenderStats total = r.retired;
+    for (RenderStats* s : r.live)
+        total.add(*s);
+    return total;
+}
+
+void printStats(std::ostream& out, const RenderStats& s, double seconds)
+{
+#ifndef RAYTRACING_STATS
+    out << "Render statistics were disabled at compile time (RAYTRACING_STATS)\n";
+#else
+    uint64_t rays = s.primaryRays + s.shadowRays + s.indirectRays;
+    auto perRay = [&](uint64_t n) { return rays ? double(n) / rays : 0.0; };
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+
+    out << "Render statistics\n";
+    out << "  rays            " << rays << " (primary " << s.primaryRays << ", shadow " << s.shadowRays
+        << ", indirect " << s.indirectRays << ")";
+    if (seconds > 0)
+        out << ", " << rays / seconds * 1e-6 << " Mrays/s";
+    out << "\n";
+    out << "  bvh nodes       " << s.bvhNodesVisited << " (" << perRay(s.bvhNodesVisited) << " per ray)\n";
+    out << "  triangle tests  " << s.triangleTests << " (" << perRay(s.triangleTests) << " per ray)\n";
+    out << "  texture lookups " << s.textureLookups << ", tile cache misses " << s.tileCacheMisses << "\n";
+    for (int i = 0; i < RenderStats::MaterialTypes; ++i)
+    {
+        if (!s.shadingCalls[i])
+            continue;
+        out << "  shading " << std::left << std::setw(11) << MaterialNames[i] << std::right
+            << s.shadingCalls[i] << " calls, " << s.shadingNanos[i] * 1e-6 << " ms ("
+            << double(s.shadingNanos[i]) / s.shadingCalls[i] << " ns per call, sampled, summed over threads)\n";
+    }
+
+    uint64_t paths = 0;
+    for (uint64_t n : s.pathLength)
+        paths += n;
+    if (paths)
+    {
+        out << "  path length (surface hits)\n";
+        for (int i = 0; i <= RenderStats::MaxPathLength; ++i)
+        {
+            if (!s.pathLength[i])
+                continue;
+            out << "    " << std::setw(3) << i << (i == RenderStats::MaxPathLength ? "+ " : "  ")
+                << std::setw(6) << 100.0 * s.pathLength[i] / paths << "%  " << s.pathLength[i] << "\n";
+        }
+    }
+    out.flags(flags);
+#endif
+}
@@ -3,3 +3,222 @@
 //
 
 #include "Texture.h"
+#include "MipMap.h"
+#include "Stats.hpp"
+#include "TileCache.h"
+#include "TextureRegistry.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+
+TileCache& TileCache::instance()
+{
+    // never destroyed, textures living in other statics still evict on exit
+    static TileCache* cache = new TileCache();
+    return *cache;
+}
+
+void TileCache::setMemoryLimit(size_t bytes)
+{
+    limit = bytes;
+}
+
+const TextureTile& TileCache::get(const MipMap& mip, uint32_t level, uint32_t tx, uint32_t ty)
+{
+    // per thread direct mapped table, hits never take a lock
+    struct Slot
+    {
+        TileKey key{0, 0, 0, 0};
+        std::shared_ptr<const TextureTile> tile;
+    };
+    constexpr size_t NumSlots = 32;
+    thread_local Slot slots[NumSlots];
+
+    TileKey key{mip.textureId(), level, tx, ty};
+    size_t hash = TileKeyHash()(key);
+    Slot& slot = slots[hash % NumSlots];
+    if (!slot.tile || !(slot.key == key))
+    {
+        slot.tile = fetch(mip, key, hash);
+        slot.key = key;
+    }
+    return *slot.tile;
+}
+
+std::shared_ptr<const TextureTile> TileCache::fetch(const MipMap& mip, const TileKey& key, size_t hash)
+{
+    Shard& shard = shards[(hash / 32) % NumShards];
+    {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it != shard.map.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return it->second->second;
+        }
+    }
+
+    // decode outside the lock, a racing thread may do the same work once
+    STAT_INC(tileCacheMisses);
+    auto tile = std::make_shared<TextureTile>(mip.tileType());
+    mip.decodeTile(key.level, key.tx, key.ty, *tile);
+
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it != shard.map.end())
+        return it->second->second;
+    shard.lru.emplace_front(key, tile);
+    shard.map[key] = shard.lru.begin();
+    shard.bytes += tile->bytes();
+    size_t tileLimit = limit - std::min(limit, encodedBytes());
+    size_t shardLimit = std::max(tileLimit / NumShards, tile->bytes());
+    while (shard.bytes > shardLimit)
+    {
+        shard.map.erase(shard.lru.back().first);
+        shard.bytes -= shard.lru.back().second->bytes();
+        shard.lru.pop_back();
+    }
+    return tile;
+}
+
+void TileCache::evict(uint32_t texture)
+{
+    for (Shard& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        for (auto it = shard.lru.begin(); it != shard.lru.end();)
+        {
+            if (it->first.texture == texture)
+            {
+                shard.map.erase(it->first);
+                shard.bytes -= it->second->bytes();
+                it = shard.lru.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+}
+
+TextureRegistry& TextureRegistry::instance()
+{
+    static TextureRegistry registry;
+    return registry;
+}
+
+std::string TextureRegistry::canonical(const std::string& name)
+{
+    std::filesystem::path path(name);
+    std::error_code ec;
+    auto canonical = std::filesystem::weakly_canonical(path, ec);
+    return (ec ? path : canonical).lexically_normal().string();
+}
+
+std::string TextureRegistry::resolve(const std::string& name) const
+{
+    std::filesystem::path path(name);
+    if (path.is_relative() && !searchPath.empty())
+        path = std::filesystem::path(searchPath) / path;
+    return canonical(path.string());
+}
+
+void TextureRegistry::setLoadOptions(const TextureLoadOptions& opts)
+{
+    // the per file formats are looked up by the paths resolve returns
+    options = opts;
+    options.formats.clear();
+    for (auto& [path, format] : opts.formats)
+        options.formats[canonical(path)] = format;
+}
+
+std::shared_ptr<ImageTexture> TextureRegistry::get(const std::string& name)
+{
+    Key key{resolve(name), options.format, options.linearize};
+    if (auto it = options.formats.find(key.path); it != options.formats.end())
+        key.format = it->second;
+
+    std::promise<std::shared_ptr<ImageTexture>> promise;
+    Handle handle;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto it = textures.find(key);
+        if (it != textures.end())
+            handle = it->second;
+        else
+            textures.emplace(key, promise.get_future().share());
+    }
+    if (handle.valid())
+        return handle.get();
+
+    std::shared_ptr<ImageTexture> texture;
+    try
+    {
+        texture = load(key);
+    }
+    catch (...)
+    {
+        // threads waiting for this load get the error, later calls try again
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            textures.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    promise.set_value(texture);
+    return texture;
+}
+
+void TextureRegistry::preload(const std::vector<std::string>& names)
+{
+    std::vector<std::string> unique(names);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+    // an exception must not leave the parallel loop, it is rethrown after it
+    std::vector<std::exception_ptr> errors(unique.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < (int)unique.size(); i++)
+    {
+        try
+        {
+            get(unique[i]);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    }
+    for (auto& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+void TextureRegistry::release()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto it = textures.begin(); it != textures.end();)
+    {
+        const auto& texture = it->second.get();
+        if (!texture || texture.use_count() == 1)
+            it = textures.erase(it);
+        else
+            ++it;
+    }
+}
+
+std::shared_ptr<ImageTexture> TextureRegistry::load(const Key& key)
+{
+    int nx, ny, nn;
+    unsigned char* data = stbi_load(key.path.c_str(), &nx, &ny, &nn, 0);
+    if (!data)
+    {
+        std::cerr << "Failed to load texture " << key.path << ": " << stbi_failure_reason() << std::endl;
+        return nullptr;
+    }
+    std::cout << "Get diffuse map : " << key.path << std::endl;
+    auto texture = std::make_shared<ImageTexture>(data, nx, ny, nn, key.format, key.linearize);
+    stbi_image_free(data);
+    return texture;
+}
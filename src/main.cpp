@@ -1,104 +1,139 @@
+#include "RenderServer.hpp"
 #include "Renderer.hpp"
 #include "Scene.hpp"
-#include "Triangle.hpp"
-#include "Sphere.hpp"
+#include "SceneFile.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
 #include <chrono>
-#include <unordered_map>
+#include <cstring>
+#include <filesystem>
 
-int main(int argc, char** argv)
+static void usage(const char* argv0)
 {
-    // Change the definition here to change resolution
-    Scene scene(1280, 720);
-
-    // Material* red = new Material(DIFFUSE, Vector3f(0.0f));
-    // red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
-    // red->diffuseTexture = std::make_shared<ConstantTexture>(red->Kd);
-    // red->specularTexture = std::make_shared<ConstantTexture>(red->Ks);
-    // Material* green = new Material(DIFFUSE, Vector3f(0.0f));
-    // green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
-    // green->diffuseTexture = std::make_shared<ConstantTexture>(green->Kd);
-    // green->specularTexture = std::make_shared<ConstantTexture>(green->Ks);
-    // Material* white = new Material(DIFFUSE, Vector3f(0.0f));
-    // white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
-    // white->diffuseTexture = std::make_shared<ConstantTexture>(white->Kd);
-    // white->specularTexture = std::make_shared<ConstantTexture>(white->Ks);
-    // // Material* light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
-    // Material* light = new Material(DIFFUSE, Vector3f(34, 24, 8));
-    // light->Kd = Vector3f(0.65f);
-    // light->diffuseTexture = std::make_shared<ConstantTexture>(light->Kd);
-    // light->specularTexture = std::make_shared<ConstantTexture>(light->Ks);
-    // Material* microfacet = new Material(MICROFACET, Vector3f(0.0f));
-    // microfacet->roughness = 0.1f;
-    // microfacet->Ks = Vector3f(0.45, 0.45, 0.45);
-    // microfacet->Kd = Vector3f(0.3, 0.3, 0.25);
-    // microfacet->ior = 12.85;
-    // microfacet->diffuseTexture = std::make_shared<ConstantTexture>(microfacet->Ks);
-    // microfacet->specularTexture = std::make_shared<ConstantTexture>(microfacet->Kd);
-    // Material* mirror = new Material(DIELECTRIC, Vector3f(0.0f));
-    // mirror->Ks = Vector3f(0.45, 0.45, 0.45);
-    // mirror->Kd = Vector3f(0.3, 0.3, 0.25);
-    // mirror->ior = 12.85;
-    // mirror->diffuseTexture = std::make_shared<ConstantTexture>(mirror->Ks);
-    // mirror->specularTexture = std::make_shared<ConstantTexture>(mirror->Kd);
+    std::cerr << "usage: " << argv0 << " <scene file> [options]\n"
+              << "       " << argv0 << " -serve <job directory>\n"
+              << "  -spp <n>          samples per pixel\n"
+              << "  -res <w> <h>      image resolution\n"
+              << "  -o <file>         output image (.ppm, .pfm or .exr)\n"
+              << "  -denoise <n>      a-trous denoiser passes, 0 disables it\n"
+              << "  -checkpoint <file> save the film there every few minutes\n"
+              << "  -resume           continue from the checkpoint if it exists\n"
+              << "  -seed <n>         fixed seed for the random sequences\n"
+              << "  -integrator <name> path, bsdf or direct (a quick preview)\n"
+              << "  -part <i> <n>     render part i of n and write its film to the output,\n"
+              << "                    combine the parts with RayTracingMerge\n"
+              << "  -frames <a> <b>   render only frames a to b of the camera animation\n"
+              << "  -serve <dir>      keep running and render the *.job files put into dir,\n"
+              << "                    scenes stay loaded between jobs, see RenderServer.hpp\n";
+}
 
-    std::unordered_map<std::string, Vector3f> emissionMapping1 = {
-        {"light1", Vector3f(300, 300, 300)},
-        {"light2", Vector3f(50, 50, 50)},
-        {"light3", Vector3f(20, 20, 20)},
-        {"light4", Vector3f(10, 10, 10)},
-    };
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
 
-    std::unordered_map<std::string, Vector3f> emissionMapping2 = {
-        {"Light", Vector3f(34.0, 24.0, 8.0)},
-    };
+    if (!strcmp(argv[1], "-serve"))
+    {
+        if (argc != 3 || !std::filesystem::is_directory(argv[2]))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        RenderServer(argv[2]).run();
+        return 0;
+    }
 
-    std::unordered_map<std::string, Vector3f> emissionMapping3 = {
-        {"Light", Vector3f(125.0, 100.0, 75.0)},
-    };
+    SceneDescription desc;
+    try
+    {
+        desc = loadSceneFile(argv[1]);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
-    // load
-    std::string modelPath = "E:/GAMES101/RayTracing/models/bathroom2/bathroom2.obj";
-    objl::Loader loader;
-    loader.LoadFile(modelPath);
+    int firstFrame = 0, lastFrame = -1; // the whole animation, if any
 
-    // add
-    auto emission = Vector3f(0.0f);
-    for (auto mesh : loader.LoadedMeshes)
+    // command line settings take precedence over the scene file
+    for (int i = 2; i < argc; ++i)
     {
-        if (emissionMapping3.find(mesh.MeshMaterial.value().name) != emissionMapping3.end())
-            emission = emissionMapping3[mesh.MeshMaterial.value().name];
-        MeshTriangle* meshTriangle = new MeshTriangle(mesh, emission);
-        scene.Add(meshTriangle);
-        emission = Vector3f(0.0f);
+        if (!strcmp(argv[i], "-spp") && i + 1 < argc)
+            desc.render.spp = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-res") && i + 2 < argc)
+        {
+            desc.width = std::max(1, atoi(argv[++i]));
+            desc.height = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            desc.render.output = argv[++i];
+        else if (!strcmp(argv[i], "-denoise") && i + 1 < argc)
+            desc.render.denoise.iterations = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-checkpoint") && i + 1 < argc)
+            desc.render.checkpoint = argv[++i];
+        else if (!strcmp(argv[i], "-resume"))
+            desc.render.resume = true;
+        else if (!strcmp(argv[i], "-seed") && i + 1 < argc)
+            desc.render.seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "-integrator") && i + 1 < argc)
+        {
+            if (!parseIntegrator(argv[++i], desc.render.integrator))
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-frames") && i + 2 < argc)
+        {
+            firstFrame = atoi(argv[++i]);
+            lastFrame = atoi(argv[++i]);
+            if (firstFrame < 0 || lastFrame < firstFrame)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-part") && i + 2 < argc)
+        {
+            desc.render.part = atoi(argv[++i]);
+            desc.render.parts = atoi(argv[++i]);
+            if (desc.render.parts < 1 || desc.render.part < 0 || desc.render.part >= desc.render.parts)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
     }
 
-    // MeshTriangle cornellbox("D:/Assignment7/models/cornell-box/cornell-box.obj", white, emissionMapping);
-
-    // MeshTriangle floor("E:/GAMES101/RayTracing/models/cornellbox/floor.obj", white);
-    // MeshTriangle shortbox("E:/GAMES101/RayTracing/models/cornellbox/shortbox.obj", white);
-    // MeshTriangle tallbox("E:/GAMES101/RayTracing/models/cornellbox/tallbox.obj", white);
-    // MeshTriangle left("E:/GAMES101/RayTracing/models/cornellbox/left.obj", red);
-    // MeshTriangle right("E:/GAMES101/RayTracing/models/cornellbox/right.obj", green);
-    // MeshTriangle light_("E:/GAMES101/RayTracing/models/cornellbox/light.obj", light);
-    // Sphere sphere1(Vector3f(150, 100, 200), 100, mirror);
-    //
-    // scene.Add(&floor);
-    // // scene.Add(&shortbox);
-    // // scene.Add(&tallbox);
-    // scene.Add(&left);
-    // scene.Add(&right);
-    // scene.Add(&light_);
-    // scene.Add(&sphere1);
-    // // scene.Add(&cornellbox);
+    Scene scene(desc.width, desc.height);
+    try
+    {
+        buildScene(desc, scene);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
     scene.buildBVH();
 
-    Renderer r;
+    Renderer r(desc.render);
 
     auto start = std::chrono::system_clock::now();
-    r.Render(scene);
+    if (lastFrame < 0 && desc.frames > 0)
+        lastFrame = desc.frames - 1;
+    bool written = lastFrame >= 0 ? r.RenderAnimation(scene, desc.cameraPath, firstFrame, lastFrame)
+                                  : r.Render(scene);
     auto stop = std::chrono::system_clock::now();
 
     std::cout << "Render complete: \n";
@@ -108,5 +143,5 @@ int main(int argc, char** argv)
     std::cout << "          : " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() <<
         " seconds\n";
 
-    return 0;
+    return written ? 0 : 1;
 }
@@ -0,0 +1,91 @@
+// Renders a test scene with the path and the bsdf integrator and compares
+// their mean radiance. Both estimate the same light transport, path by
+// sampling the lights and bsdf by hitting them, so a bias in the light
+// sampling or in the way path avoids counting lights twice shows up as a
+// difference far above the noise of the mean.
+#include <cstring>
+#include <filesystem>
+#include "ImageIO.hpp"
+#include "Renderer.hpp"
+#include "SceneFile.hpp"
+
+static void usage(const char* argv0)
+{
+    std::cerr << "usage: " << argv0 << " <scene file> [-tolerance <t>]\n"
+              << "  -tolerance <t>    largest relative difference of the means that passes (default 0.03)\n";
+}
+
+// mean over all pixels and channels of the scene rendered with integrator,
+// negative if the render can't be read back
+static double renderMean(const SceneDescription& desc, IntegratorType integrator, const std::string& name)
+{
+    RenderOptions options = desc.render;
+    if (!options.seed)
+        options.seed = 1;
+    options.integrator = integrator;
+    options.aovs = 0;
+    options.denoise.iterations = 0;
+    options.checkpoint.clear();
+    options.part = 0, options.parts = 1;
+    options.output = (std::filesystem::temp_directory_path() / ("raytracing_integrators_" + name + ".pfm")).string();
+
+    Scene scene(desc.width, desc.height);
+    buildScene(desc, scene);
+    scene.buildBVH();
+    Renderer(options).Render(scene);
+
+    int width, height;
+    ImageLayer image;
+    bool rendered = readPFM(options.output, width, height, image);
+    std::filesystem::remove(options.output);
+    if (!rendered || image.data.empty())
+        return -1;
+    double sum = 0;
+    for (float v : image.data)
+        sum += v;
+    return sum / image.data.size();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    double tolerance = 0.03;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-tolerance") && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    double path, bsdf;
+    try
+    {
+        SceneDescription desc = loadSceneFile(argv[1]);
+        path = renderMean(desc, IntegratorType::PATH, "path");
+        bsdf = renderMean(desc, IntegratorType::BSDF, "bsdf");
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (path <= 0 || bsdf <= 0)
+    {
+        std::cerr << "Cannot read the renders back\n";
+        return 1;
+    }
+
+    double difference = std::fabs(path - bsdf) / bsdf;
+    bool pass = difference <= tolerance;
+    std::cout << (pass ? "PASS" : "FAIL") << ": mean " << path << " with path, " << bsdf
+              << " with bsdf, relative difference " << difference << ", tolerance " << tolerance << "\n";
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+// Moves the vertices of a mesh in several ways and checks after each
+// BVHAccel::Refit that the mesh BVH finds the same closest hits as testing
+// every triangle, and that it rebuilt the tree exactly when it should have:
+// when the SAH cost grew past the threshold and when the mesh started or
+// stopped moving over the shutter interval.
+#include <algorithm>
+#include <functional>
+#include "Scene.hpp"
+#include "Triangle.hpp"
+#include "global.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what)
+{
+    std::cout << (condition ? "PASS: " : "FAIL: ") << what << "\n";
+    failures += !condition;
+}
+
+// rays from around the mesh towards points inside its bounds, at random
+// shutter times
+static std::vector<Ray> randomRays(Bounds3 bounds, int count)
+{
+    Vector3f extent = bounds.Diagonal();
+    auto pointIn = [&](float scale) {
+        Vector3f r(get_random_float(), get_random_float(), get_random_float());
+        return bounds.Centroid() + (r - Vector3f(0.5f)) * extent * scale;
+    };
+    std::vector<Ray> rays;
+    for (int i = 0; i < count; ++i)
+    {
+        Vector3f origin = pointIn(3);
+        Ray ray(origin, normalize(pointIn(1) - origin));
+        ray.time = get_random_float();
+        rays.push_back(ray);
+    }
+    return rays;
+}
+
+// rays whose closest hit through the BVH differs from the brute force one
+static int mismatches(MeshTriangle& mesh, const std::vector<Ray>& rays)
+{
+    int count = 0;
+    for (auto& ray : rays)
+    {
+        HitRecord expected;
+        for (auto& tri : mesh.triangles)
+            tri.intersect(ray, expected);
+        HitRecord hit;
+        bool found = mesh.intersect(ray, hit);
+        if (found != (expected.obj != nullptr) || hit.t != expected.t)
+            ++count;
+    }
+    return count;
+}
+
+static void moveVertices(MeshTriangle& mesh, const std::function<Vector3f(const Vector3f&)>& move)
+{
+    for (auto& v : mesh.vertices)
+        v = move(v);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <mesh.obj>\n";
+        return 1;
+    }
+
+    Scene scene(64, 64);
+    MeshTriangle* mesh;
+    try
+    {
+        Material* material = scene.arena.create<Material>(DIFFUSE, Vector3f(0));
+        mesh = scene.arena.create<MeshTriangle>(scene.arena, argv[1], material);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    scene.Add(mesh);
+    scene.buildBVH();
+
+    seed_random(1, 0, 0);
+    const int rayCount = 20000;
+    Bounds3 original = mesh->getBounds();
+    const Vector3f extent = original.Diagonal();
+    auto jitter = [&](float amount) {
+        return [&, amount](const Vector3f& v) {
+            Vector3f r(get_random_float(), get_random_float(), get_random_float());
+            return v + (r - Vector3f(0.5f)) * extent * amount;
+        };
+    };
+
+    check(mismatches(*mesh, randomRays(original, rayCount)) == 0, "hits after the build");
+
+    // a slight deformation keeps the tree
+    moveVertices(*mesh, jitter(0.002f));
+    check(!mesh->refit(), "a slight deformation is refit");
+    check(mismatches(*mesh, randomRays(mesh->getBounds(), rayCount)) == 0, "hits after a refit");
+
+    // a strong one is only refit when no cost increase triggers a rebuild
+    moveVertices(*mesh, jitter(0.5f));
+    check(!mesh->refit(std::numeric_limits<float>::infinity()), "a forced refit keeps the tree");
+    check(mismatches(*mesh, randomRays(mesh->getBounds(), rayCount)) == 0, "hits after a forced refit");
+    float refitCost = mesh->bvh->SAHCost();
+
+    // refitting to the same vertices again leaves the cost where it is, far
+    // above that of the last build
+    check(mesh->refit(), "the cost increase triggers a rebuild");
+    check(mesh->bvh->SAHCost() < refitCost, "the rebuild lowers the cost");
+    check(mismatches(*mesh, randomRays(mesh->getBounds(), rayCount)) == 0, "hits after the rebuild");
+
+    // starting and stopping to move changes the kind of tree
+    check(mesh->isMoving() == false && !mesh->bvh->motion, "the mesh is static");
+    mesh->setMotion(extent * 0.3f);
+    check(mesh->bvh->motion, "setMotion rebuilds a motion BVH");
+    check(mismatches(*mesh, randomRays(Union(mesh->getBounds(), mesh->getMotionBounds()), rayCount)) == 0,
+          "hits at random shutter times");
+    scene.refitBVH();
+    check(scene.bvh->motion && scene.motionBlur, "the scene turns on motion blur after a refit");
+
+    mesh->verticesClose.clear();
+    check(mesh->refit() && !mesh->bvh->motion, "a mesh that stops moving gets a static BVH");
+    check(mismatches(*mesh, randomRays(mesh->getBounds(), rayCount)) == 0, "hits after stopping");
+    scene.refitBVH();
+    check(!scene.bvh->motion && !scene.motionBlur, "the scene turns off motion blur after a refit");
+
+    return failures ? 1 : 0;
+}
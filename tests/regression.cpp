@@ -0,0 +1,129 @@
+// Renders a test scene with a fixed seed and compares the result against a
+// stored float reference, so that refactors can't silently change the image.
+// The error metric is the relative MSE
+//
+//   mean over all pixels and channels of (render - ref)^2 / (ref^2 + 0.01)
+//
+// which weighs dark and bright regions alike. A different random sequence
+// alone gives an error of the order of the noise (about 1e-2 for the test
+// scenes), far above the default tolerance.
+#include <cstring>
+#include <filesystem>
+#include "ImageIO.hpp"
+#include "Renderer.hpp"
+#include "SceneFile.hpp"
+
+static void usage(const char* argv0)
+{
+    std::cerr << "usage: " << argv0 << " <scene file> <reference.pfm> [options]\n"
+              << "  -tolerance <t>    largest relative MSE that passes (default 1e-3)\n"
+              << "  -update           render the reference instead of comparing to it\n";
+}
+
+static double relativeMSE(const ImageLayer& image, const ImageLayer& reference)
+{
+    double sum = 0;
+    for (size_t i = 0; i < image.data.size(); ++i)
+    {
+        double d = image.data[i] - reference.data[i];
+        sum += d * d / (double(reference.data[i]) * reference.data[i] + 0.01);
+    }
+    return sum / image.data.size();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string referenceFile = argv[2];
+    double tolerance = 1e-3;
+    bool update = false;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-tolerance") && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-update"))
+            update = true;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    SceneDescription desc;
+    try
+    {
+        desc = loadSceneFile(argv[1]);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // only the beauty pass, in one go and always with the same random sequences
+    RenderOptions& options = desc.render;
+    if (!options.seed)
+        options.seed = 1;
+    options.aovs = 0;
+    options.denoise.iterations = 0;
+    options.checkpoint.clear();
+    options.part = 0, options.parts = 1;
+    options.output = update ? referenceFile
+                            : (std::filesystem::temp_directory_path() /
+                               ("raytracing_regression_" + std::filesystem::path(referenceFile).filename().string()))
+                                  .string();
+    if (std::filesystem::path(options.output).extension() != ".pfm")
+    {
+        std::cerr << "The reference has to be a .pfm file\n";
+        return 1;
+    }
+
+    Scene scene(desc.width, desc.height);
+    try
+    {
+        buildScene(desc, scene);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    scene.buildBVH();
+    Renderer(options).Render(scene);
+    if (update)
+    {
+        std::cout << "reference written to " << referenceFile << "\n";
+        return 0;
+    }
+
+    int width, height, refWidth, refHeight;
+    ImageLayer image, reference;
+    bool rendered = readPFM(options.output, width, height, image);
+    std::filesystem::remove(options.output);
+    if (!rendered)
+    {
+        std::cerr << "Cannot read the render back from " << options.output << "\n";
+        return 1;
+    }
+    if (!readPFM(referenceFile, refWidth, refHeight, reference))
+    {
+        std::cerr << "Cannot read reference " << referenceFile << ", create it with -update\n";
+        return 1;
+    }
+    if (width != refWidth || height != refHeight || image.channels != reference.channels)
+    {
+        std::cerr << "The render is " << width << "x" << height << ", the reference " << refWidth << "x"
+                  << refHeight << "\n";
+        return 1;
+    }
+
+    double error = relativeMSE(image, reference);
+    bool pass = error <= tolerance;
+    std::cout << (pass ? "PASS" : "FAIL") << ": relative MSE " << error << ", tolerance " << tolerance << "\n";
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+// Checks the sample positions of Renderer::pixelSample: inside the pixel,
+// centered on it on average for low sample counts too, and stratified, with
+// every quadrant taken by the first 4 samples and every stratum by 16.
+#include "Renderer.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what)
+{
+    std::cout << (condition ? "PASS: " : "FAIL: ") << what << "\n";
+    failures += !condition;
+}
+
+int main()
+{
+    const uint64_t seed = 1;
+    const int pixels = 128 * 128;
+
+    for (int spp : {1, 4, 8, 16, 32})
+    {
+        double sumX = 0, sumY = 0;
+        bool inside = true;
+        for (int pixel = 0; pixel < pixels; ++pixel)
+            for (int k = 0; k < spp; ++k)
+            {
+                seed_random(seed, pixel, k);
+                Vector2f p = Renderer::pixelSample(seed, pixel, k);
+                inside &= p.x >= 0 && p.x < 1 && p.y >= 0 && p.y < 1;
+                sumX += p.x, sumY += p.y;
+            }
+        double meanX = sumX / (pixels * spp), meanY = sumY / (pixels * spp);
+        std::string name = "spp " + std::to_string(spp) + ": ";
+        check(inside, name + "samples stay inside the pixel");
+        // the standard error of the mean is below 0.003 here
+        check(std::fabs(meanX - 0.5) < 0.01 && std::fabs(meanY - 0.5) < 0.01,
+              name + "mean offset (" + std::to_string(meanX) + ", " + std::to_string(meanY) + ") is the center");
+    }
+
+    bool quadrants = true, strata = true;
+    for (int pixel = 0; pixel < pixels; ++pixel)
+    {
+        int quadrant = 0, stratum = 0;
+        for (int k = 0; k < 16; ++k)
+        {
+            seed_random(seed, pixel, k);
+            Vector2f p = Renderer::pixelSample(seed, pixel, k);
+            if (k < 4)
+                quadrant |= 1 << (int(p.y * 2) * 2 + int(p.x * 2));
+            stratum |= 1 << (int(p.y * 4) * 4 + int(p.x * 4));
+        }
+        quadrants &= quadrant == 0xf;
+        strata &= stratum == 0xffff;
+    }
+    check(quadrants, "the first 4 samples of a pixel take one quadrant each");
+    check(strata, "16 samples of a pixel take one stratum each");
+
+    return failures ? 1 : 0;
+}
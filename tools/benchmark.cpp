@@ -0,0 +1,406 @@
+// Micro and end-to-end benchmarks over the bundled models, results go to a
+// JSON file for tracking them over time:
+//
+//   bvh_build   BVH construction over the triangles of each model
+//   rays        primary, shadow and random rays per second
+//   materials   sample/pdf/eval calls per second for each MaterialType
+//   frame       full render of scenes/cornellbox.scene at a fixed spp
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <omp.h>
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include "SceneFile.hpp"
+#include "Triangle.hpp"
+
+#ifndef RAYTRACING_SOURCE_DIR
+#define RAYTRACING_SOURCE_DIR "."
+#endif
+
+namespace
+{
+struct Settings
+{
+    std::string root = RAYTRACING_SOURCE_DIR;
+    std::string output = "benchmark.json";
+    int repeats = 3;
+    int frameSize = 128, frameSpp = 16;
+};
+
+// best of several runs, the least disturbed by the rest of the machine
+double bestTime(int repeats, const std::function<void()>& f)
+{
+    double best = 1e30;
+    for (int i = 0; i < repeats; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+        best = std::min(best, d.count());
+    }
+    return best;
+}
+
+// keeps the optimizer from dropping the measured work
+volatile float sink;
+
+// collects the results as a JSON document
+class JsonWriter
+{
+public:
+    void beginObject(const std::string& key = "") { open(key, '{'); }
+    void endObject() { close('}'); }
+    void beginArray(const std::string& key) { open(key, '['); }
+    void endArray() { close(']'); }
+
+    void value(const std::string& key, double v)
+    {
+        std::ostringstream s;
+        s.precision(6);
+        s << v;
+        item(key, s.str());
+    }
+    void value(const std::string& key, long long v) { item(key, std::to_string(v)); }
+    void value(const std::string& key, int v) { value(key, (long long)v); }
+    void value(const std::string& key, const std::string& v) { item(key, "\"" + v + "\""); }
+
+    std::string str() const { return out.str() + "\n"; }
+
+private:
+    void separator()
+    {
+        if (!first.empty())
+        {
+            if (!first.back())
+                out << ",";
+            first.back() = false;
+            out << "\n" << std::string(first.size() * 2, ' ');
+        }
+    }
+    void open(const std::string& key, char bracket)
+    {
+        separator();
+        if (!key.empty())
+            out << "\"" << key << "\": ";
+        out << bracket;
+        first.push_back(true);
+    }
+    void close(char bracket)
+    {
+        first.pop_back();
+        out << "\n" << std::string(first.size() * 2, ' ') << bracket;
+    }
+    void item(const std::string& key, const std::string& v)
+    {
+        separator();
+        out << "\"" << key << "\": " << v;
+    }
+
+    std::ostringstream out;
+    std::vector<bool> first;
+};
+
+struct Model
+{
+    std::string name;
+    std::vector<std::string> files;
+    Camera camera;
+};
+
+std::vector<Model> bundledModels(const std::string& root)
+{
+    Model bunny{"bunny", {root + "/models/bunny/bunny.obj"}, Camera()};
+    bunny.camera.eye = Vector3f(-0.02, 0.11, 0.3);
+    bunny.camera.lookAt = Vector3f(-0.02, 0.1, 0);
+    bunny.camera.fov = 40;
+
+    Model cornell{"cornellbox", {}, Camera()};
+    for (const char* part : {"floor", "shortbox", "tallbox", "left", "right", "light"})
+        cornell.files.push_back(root + "/models/cornellbox/" + part + ".obj");
+    cornell.camera.eye = Vector3f(278, 273, -800);
+    cornell.camera.lookAt = Vector3f(278, 273, 0);
+    cornell.camera.fov = 40;
+    return {bunny, cornell};
+}
+
+Vector3f randomDirection()
+{
+    float z = 1 - 2 * get_random_float();
+    float r = std::sqrt(std::max(0.f, 1 - z * z));
+    float phi = 2 * M_PI * get_random_float();
+    return Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// closest hits per second over a fixed set of rays, in parallel
+void timeRays(JsonWriter& json, const Settings& settings, const std::string& model, const Scene& scene,
+              const std::string& kind, const std::vector<Ray>& rays)
+{
+    double seconds = bestTime(settings.repeats, [&] {
+        float hits = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+ : hits)
+        for (int i = 0; i < (int)rays.size(); ++i)
+        {
+            HitRecord hit;
+            hits += scene.intersect(rays[i], hit);
+        }
+        sink = hits;
+    });
+    json.beginObject();
+    json.value("model", model);
+    json.value("kind", kind);
+    json.value("rays", (long long)rays.size());
+    json.value("seconds", seconds);
+    json.value("mrays_per_second", rays.size() / seconds * 1e-6);
+    json.endObject();
+    std::cerr << "  " << model << " " << kind << ": " << rays.size() / seconds * 1e-6 << " Mrays/s\n";
+}
+
+// a model loaded into a scene of its own
+struct LoadedModel
+{
+    Model model;
+    std::vector<Object*> triangles;
+    Scene scene{256, 256};
+};
+
+std::unique_ptr<LoadedModel> loadModel(const Model& model)
+{
+    auto loaded = std::make_unique<LoadedModel>();
+    loaded->model = model;
+    MemoryArena& arena = loaded->scene.arena;
+    Material* material = arena.create<Material>(DIFFUSE, Vector3f(0));
+    for (auto& file : model.files)
+    {
+        auto* mesh = arena.create<MeshTriangle>(arena, file, material);
+        for (auto& t : mesh->triangles)
+            loaded->triangles.push_back(&t);
+        loaded->scene.Add(mesh);
+    }
+    loaded->scene.buildBVH();
+    Camera& camera = loaded->scene.camera;
+    camera = model.camera;
+    camera.width = loaded->scene.width;
+    camera.height = loaded->scene.height;
+    camera.update();
+    return loaded;
+}
+
+// BVH over all triangles of the model, as one flat list
+void benchmarkBuild(JsonWriter& json, const Settings& settings, const LoadedModel& m)
+{
+    // Build rather than the constructor, which prints its timing
+    BVHAccel bvh(m.triangles);
+    double seconds = bestTime(settings.repeats, [&] { bvh.Build(); });
+    // nothing moved, so this is the bottom-up pass alone
+    double refitSeconds = bestTime(settings.repeats, [&] { bvh.Refit(); });
+    json.beginObject();
+    json.value("model", m.model.name);
+    json.value("triangles", (long long)m.triangles.size());
+    json.value("seconds", seconds);
+    json.value("refitSeconds", refitSeconds);
+    json.endObject();
+    std::cerr << "  " << m.model.name << " bvh build: " << seconds * 1e3 << " ms, refit: " << refitSeconds * 1e3
+              << " ms\n";
+}
+
+void benchmarkRays(JsonWriter& json, const Settings& settings, LoadedModel& m)
+{
+    Scene& scene = m.scene;
+    Bounds3 bounds = scene.bvh->WorldBound();
+    Vector3f extent = bounds.Diagonal();
+
+    seed_random(1, 0, 0);
+    std::vector<Ray> primary, shadow, random;
+    std::vector<CameraSample> samples;
+    for (int y = 0; y < scene.height; ++y)
+        for (int x = 0; x < scene.width; ++x)
+            samples.push_back({x + 0.5f, y + 0.5f});
+    scene.camera.generateRays(samples, primary);
+
+    // shadow rays from the visible points towards the top of the model
+    Vector3f light = bounds.Centroid() + Vector3f(0, extent.y * 0.45f, 0);
+    for (auto& ray : primary)
+    {
+        Intersection hit = scene.intersect(ray);
+        if (hit.happened)
+            shadow.emplace_back(hit.coords + hit.normal * epsilon, normalize(light - hit.coords));
+    }
+
+    for (size_t i = 0; i < primary.size(); ++i)
+    {
+        Vector3f o = bounds.pMin + Vector3f(get_random_float() * extent.x, get_random_float() * extent.y,
+                                            get_random_float() * extent.z);
+        random.emplace_back(o, randomDirection());
+    }
+
+    for (auto& [kind, rays] : {std::make_pair("primary", &primary), std::make_pair("shadow", &shadow),
+                               std::make_pair("random", &random)})
+        timeRays(json, settings, m.model.name, scene, kind, *rays);
+}
+
+void benchmarkMaterials(JsonWriter& json, const Settings& settings)
+{
+    const int n = 1 << 20;
+    const char* names[] = {"diffuse", "microfacet", "dielectric"};
+    seed_random(2, 0, 0);
+    std::vector<Vector3f> wo(n), wi(n);
+    for (int i = 0; i < n; ++i)
+    {
+        // upper hemisphere around N = (0, 0, 1)
+        wo[i] = randomDirection(), wi[i] = randomDirection();
+        wo[i].z = std::fabs(wo[i].z), wi[i].z = std::fabs(wi[i].z);
+    }
+    Vector3f N(0, 0, 1);
+    Vector2f uv(0.5f, 0.5f);
+
+    for (MaterialType type : {DIFFUSE, MICROFACET, DIELECTRIC})
+    {
+        Material material(type, Vector3f(0));
+        material.roughness = 0.3f;
+        MaterialRecord m = MaterialTable::compile(material);
+        double sample = bestTime(settings.repeats, [&] {
+            float s = 0;
+            for (int i = 0; i < n; ++i)
+                s += sampleMaterial(m, wo[i], N).z;
+            sink = s;
+        });
+        double pdf = bestTime(settings.repeats, [&] {
+            float s = 0;
+            for (int i = 0; i < n; ++i)
+                s += materialPdf(m, wo[i], wi[i], N);
+            sink = s;
+        });
+        double eval = bestTime(settings.repeats, [&] {
+            float s = 0;
+            for (int i = 0; i < n; ++i)
+                s += evalMaterial(m, wi[i], wo[i], N, uv).x;
+            sink = s;
+        });
+        json.beginObject();
+        json.value("type", names[type]);
+        json.value("calls", n);
+        json.value("sample_per_second", n / sample);
+        json.value("pdf_per_second", n / pdf);
+        json.value("eval_per_second", n / eval);
+        json.endObject();
+        std::cerr << "  " << names[type] << ": sample " << n / sample * 1e-6 << " M/s, pdf " << n / pdf * 1e-6
+                  << " M/s, eval " << n / eval * 1e-6 << " M/s (single thread)\n";
+    }
+}
+
+void benchmarkFrame(JsonWriter& json, const Settings& settings)
+{
+    SceneDescription desc = loadSceneFile(settings.root + "/scenes/cornellbox.scene");
+    desc.width = desc.height = settings.frameSize;
+    desc.render.spp = settings.frameSpp;
+    desc.render.seed = 1;
+    desc.render.output = (std::filesystem::temp_directory_path() / "raytracing_benchmark.pfm").string();
+
+    Scene scene(desc.width, desc.height);
+    buildScene(desc, scene);
+    scene.buildBVH();
+    Renderer renderer(desc.render);
+    double seconds = bestTime(settings.repeats, [&] { renderer.Render(scene); });
+    std::filesystem::remove(desc.render.output);
+
+    json.beginObject("frame");
+    json.value("scene", "cornellbox");
+    json.value("width", desc.width);
+    json.value("height", desc.height);
+    json.value("spp", desc.render.spp);
+    json.value("seconds", seconds);
+    json.endObject();
+    std::cerr << "  cornellbox frame " << desc.width << "x" << desc.height << " at " << desc.render.spp
+              << " spp: " << seconds << " s\n";
+}
+
+void usage(const char* argv0)
+{
+    std::cerr << "usage: " << argv0 << " [options]\n"
+              << "  -o <file>         JSON results (default benchmark.json)\n"
+              << "  -root <dir>       repository with models/ and scenes/\n"
+              << "  -repeats <n>      runs per measurement, the best one counts\n"
+              << "  -frame <size> <spp>  resolution and spp of the full frame\n";
+}
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            settings.output = argv[++i];
+        else if (!strcmp(argv[i], "-root") && i + 1 < argc)
+            settings.root = argv[++i];
+        else if (!strcmp(argv[i], "-repeats") && i + 1 < argc)
+            settings.repeats = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-frame") && i + 2 < argc)
+        {
+            settings.frameSize = std::max(1, atoi(argv[++i]));
+            settings.frameSpp = std::max(1, atoi(argv[++i]));
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    JsonWriter json;
+    json.beginObject();
+    json.value("date", date);
+    json.value("threads", omp_get_max_threads());
+    json.value("repeats", settings.repeats);
+    try
+    {
+        std::vector<std::unique_ptr<LoadedModel>> models;
+        for (auto& model : bundledModels(settings.root))
+            models.push_back(loadModel(model));
+
+        std::cerr << "bvh build\n";
+        json.beginArray("bvh_build");
+        for (auto& m : models)
+            benchmarkBuild(json, settings, *m);
+        json.endArray();
+
+        std::cerr << "rays\n";
+        json.beginArray("rays");
+        for (auto& m : models)
+            benchmarkRays(json, settings, *m);
+        json.endArray();
+
+        std::cerr << "materials\n";
+        json.beginArray("materials");
+        benchmarkMaterials(json, settings);
+        json.endArray();
+
+        std::cerr << "frame\n";
+        benchmarkFrame(json, settings);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    json.endObject();
+
+    std::ofstream out(settings.output);
+    out << json.str();
+    if (!out)
+    {
+        std::cerr << "Cannot write " << settings.output << "\n";
+        return 1;
+    }
+    std::cerr << "results written to " << settings.output << "\n";
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Combines the partial films written by `RayTracing <scene> -part i n` into
+// the final image. The output settings (file, EXR options, AOVs, denoiser)
+// come from the same scene file.
+#include <cstring>
+#include "Film.hpp"
+#include "Renderer.hpp"
+#include "SceneFile.hpp"
+
+static void usage(const char* argv0)
+{
+    std::cerr << "usage: " << argv0 << " <scene file> [options] <film>...\n"
+              << "  -o <file>         output image (.ppm, .pfm or .exr)\n"
+              << "  -denoise <n>      a-trous denoiser passes, 0 disables it\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    SceneDescription desc;
+    try
+    {
+        desc = loadSceneFile(argv[1]);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> films;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            desc.render.output = argv[++i];
+        else if (!strcmp(argv[i], "-denoise") && i + 1 < argc)
+            desc.render.denoise.iterations = std::max(0, atoi(argv[++i]));
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+            films.push_back(argv[i]);
+    }
+    if (films.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Film film;
+    RenderProgress first;
+    for (size_t i = 0; i < films.size(); ++i)
+    {
+        Film part;
+        RenderProgress progress;
+        if (!part.load(films[i], progress))
+        {
+            std::cerr << "Cannot read film " << films[i] << "\n";
+            return 1;
+        }
+        if (i == 0)
+        {
+            film = std::move(part);
+            first = progress;
+            continue;
+        }
+        if (progress.seed != first.seed || progress.spp != first.spp)
+            std::cerr << films[i] << " was rendered with a different seed or spp than " << films[0] << "\n";
+        if (progress.sceneHash != first.sceneHash)
+            std::cerr << films[i] << " was made with another scene, camera or integrator than " << films[0] << "\n";
+        if (progress.parts != first.parts || progress.partition != first.partition)
+            std::cerr << films[i] << " was split into parts differently than " << films[0] << "\n";
+        if (!film.merge(part))
+        {
+            std::cerr << films[i] << " doesn't match the resolution or AOVs of " << films[0] << "\n";
+            return 1;
+        }
+    }
+
+    size_t missing = std::count(film.sampleCount.begin(), film.sampleCount.end(), 0u);
+    if (missing)
+        std::cerr << "warning: " << missing << " pixels have no samples, is a part missing?\n";
+
+    if (!Renderer::writeFilm(film, desc.render))
+    {
+        std::cerr << "Cannot write " << desc.render.output << "\n";
+        return 1;
+    }
+    return 0;
+}